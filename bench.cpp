@@ -0,0 +1,202 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "math/ray.hpp"
+#include "math/vector.hpp"
+#include "shapes/sphere.hpp"
+#include "shapes/triangle.hpp"
+
+// Microbenchmarks for low-level intersection kernels
+// Every kernel is run over the same random rays and primitives so that both
+// throughput and the number of reported hits can be compared
+
+static constexpr int BENCH_RAYS = 4096;
+static constexpr int BENCH_TRIANGLES = 256;
+static constexpr int BENCH_SPHERES = 256;
+
+// Time a kernel over every ray/primitive pair and print throughput
+void run_bench(const std::string& name, const std::function<int()>& kernel,
+               long long tests) {
+  const auto start = std::chrono::steady_clock::now();
+  const int hits = kernel();
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  std::cout << "  " << name << ": " << tests / seconds / 1e6
+            << " M tests/s, " << hits << " hits" << std::endl;
+}
+
+void bench_triangle() {
+  std::cout << "Benchmarking triangle intersection..." << std::endl;
+
+  std::mt19937 rng(221);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  auto randomVector = [&]() { return Vector(dist(rng), dist(rng), dist(rng)); };
+
+  std::vector<Vector> v0s, v1s, v2s, e1s, e2s;
+  for (int i = 0; i < BENCH_TRIANGLES; ++i) {
+    const Vector a = randomVector();
+    const Vector b = a + randomVector() * 0.5;
+    const Vector c = a + randomVector() * 0.5;
+    v0s.push_back(a);
+    v1s.push_back(b);
+    v2s.push_back(c);
+    e1s.push_back(b - a);
+    e2s.push_back(c - a);
+  }
+  std::vector<Ray> rays;
+  for (int i = 0; i < BENCH_RAYS; ++i) {
+    rays.emplace_back(randomVector() * 3.0, randomVector().norm());
+  }
+  const long long tests =
+      static_cast<long long>(BENCH_RAYS) * BENCH_TRIANGLES;
+
+  run_bench("moller-trumbore, edges per test", [&]() {
+    int hits = 0;
+    double t, u, v;
+    for (const Ray& ray : rays) {
+      for (int i = 0; i < BENCH_TRIANGLES; ++i) {
+        hits += intersectTriangle(ray, v0s[i], v1s[i] - v0s[i],
+                                  v2s[i] - v0s[i], t, u, v);
+      }
+    }
+    return hits;
+  }, tests);
+
+  run_bench("moller-trumbore, precomputed edges", [&]() {
+    int hits = 0;
+    double t, u, v;
+    for (const Ray& ray : rays) {
+      for (int i = 0; i < BENCH_TRIANGLES; ++i) {
+        hits += intersectTriangle(ray, v0s[i], e1s[i], e2s[i], t, u, v);
+      }
+    }
+    return hits;
+  }, tests);
+
+  // Reports at most one hit (the nearest) per pack
+  std::vector<TrianglePack> packs(BENCH_TRIANGLES / TrianglePack::WIDTH);
+  for (int i = 0; i < BENCH_TRIANGLES; ++i) {
+    packs[i / TrianglePack::WIDTH].set(i % TrianglePack::WIDTH, v0s[i], e1s[i],
+                                       e2s[i]);
+  }
+  run_bench("moller-trumbore, packs of " +
+                std::to_string(TrianglePack::WIDTH), [&]() {
+    int hits = 0;
+    double t, u, v;
+    for (const Ray& ray : rays) {
+      const RayT<Real> packRay(ray);
+      for (const TrianglePack& pack : packs) {
+        hits += pack.intersect(packRay, t, u, v) >= 0;
+      }
+    }
+    return hits;
+  }, tests);
+
+  run_bench("watertight", [&]() {
+    int hits = 0;
+    double t, u, v;
+    for (const Ray& ray : rays) {
+      for (int i = 0; i < BENCH_TRIANGLES; ++i) {
+        hits += intersectTriangleWatertight(ray, v0s[i], v1s[i], v2s[i], t, u,
+                                            v);
+      }
+    }
+    return hits;
+  }, tests);
+}
+
+void bench_sphere() {
+  std::cout << "Benchmarking sphere intersection..." << std::endl;
+
+  std::mt19937 rng(221);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  auto randomVector = [&]() { return Vector(dist(rng), dist(rng), dist(rng)); };
+
+  std::vector<Vector> centers;
+  std::vector<double> radii;
+  for (int i = 0; i < BENCH_SPHERES; ++i) {
+    centers.push_back(randomVector());
+    radii.push_back(0.05 + 0.05 * std::abs(dist(rng)));
+  }
+  std::vector<Ray> rays;
+  for (int i = 0; i < BENCH_RAYS; ++i) {
+    rays.emplace_back(randomVector() * 3.0, randomVector().norm());
+  }
+  const long long tests = static_cast<long long>(BENCH_RAYS) * BENCH_SPHERES;
+
+  run_bench("quadratic, one at a time", [&]() {
+    int hits = 0;
+    double t;
+    for (const Ray& ray : rays) {
+      for (int i = 0; i < BENCH_SPHERES; ++i) {
+        hits += intersectSphere(ray, centers[i], radii[i], t);
+      }
+    }
+    return hits;
+  }, tests);
+
+  // Reports at most one hit (the nearest) per pack
+  std::vector<SpherePack> packs(BENCH_SPHERES / SpherePack::WIDTH);
+  for (int i = 0; i < BENCH_SPHERES; ++i) {
+    packs[i / SpherePack::WIDTH].set(i % SpherePack::WIDTH, centers[i],
+                                     radii[i]);
+  }
+  run_bench("packs of " + std::to_string(SpherePack::WIDTH), [&]() {
+    int hits = 0;
+    double t, u, v;
+    for (const Ray& ray : rays) {
+      const RayT<Real> packRay(ray);
+      for (const SpherePack& pack : packs) {
+        hits += pack.intersect(packRay, t, u, v) >= 0;
+      }
+    }
+    return hits;
+  }, tests);
+}
+
+void bench_triangle_shared_edge() {
+  std::cout << "Counting rays leaking through a shared triangle edge..."
+            << std::endl;
+
+  // Two triangles sharing the diagonal from a to c of a skewed quad
+  const Vector a(0.1, 0.3, 0.7), b(1.3, 0.2, 0.9), c(1.1, 1.4, 0.6),
+      d(0.2, 1.2, 0.8);
+
+  std::mt19937 rng(221);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  const Vector origin(0.5, 0.6, 3.0);
+  int leaksMT = 0, leaksWatertight = 0;
+  double t, u, v;
+  for (int i = 0; i < BENCH_RAYS * 16; ++i) {
+    // Aim at a random point exactly on the shared edge
+    const Vector target = a + (c - a) * dist(rng);
+    const Ray ray(origin, target - origin);
+    if (!intersectTriangle(ray, a, b - a, c - a, t, u, v) &&
+        !intersectTriangle(ray, a, c - a, d - a, t, u, v)) {
+      leaksMT++;
+    }
+    if (!intersectTriangleWatertight(ray, a, b, c, t, u, v) &&
+        !intersectTriangleWatertight(ray, a, c, d, t, u, v)) {
+      leaksWatertight++;
+    }
+  }
+  std::cout << "  moller-trumbore: " << leaksMT << " leaks" << std::endl;
+  std::cout << "  watertight: " << leaksWatertight << " leaks" << std::endl;
+}
+
+int main() {
+  bench_triangle();
+  bench_sphere();
+  bench_triangle_shared_edge();
+
+  return 0;
+}
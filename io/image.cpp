@@ -17,10 +17,11 @@ Image::Image(Scene& sc, int quality)
   const Pixels tempPixels(sc.getWidth(), sc.getHeight());
   Tracer tracer{sc};
 
+  // Each pass decides which pixels to sample from the ones before it
   for (int q = 0; q < quality; ++q) {
     tracer.refinePixels(const_cast<Pixels&>(tempPixels));
+    tracer.wait();
   }
-  tracer.wait();
 
   // Convert to 8-bit per channel
   for (int y = 0; y < sc.getHeight(); ++y) {
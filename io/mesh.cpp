@@ -1,11 +1,18 @@
 #include <stddef.h>
+#include <stdint.h>
 
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "math/transform.hpp"
 #include "math/vector.hpp"
+#include "scene/prototype.hpp"
 #include "scene/scene.hpp"
 
 // Forward declaration
@@ -26,8 +33,32 @@ std::vector<std::string> splitByChar(std::string string, char splitter) {
   return blocks;
 }
 
+// Drop the vertices indices does not use and renumber it to match
+static void compactVertices(std::vector<Vector>& positions,
+                            std::vector<Vector>& normals,
+                            std::vector<uint32_t>& indices) {
+  constexpr uint32_t UNUSED = UINT32_MAX;
+  std::vector<uint32_t> remap(positions.size(), UNUSED);
+  std::vector<Vector> usedPositions;
+  std::vector<Vector> usedNormals;
+  for (uint32_t& index : indices) {
+    if (remap[index] == UNUSED) {
+      remap[index] = static_cast<uint32_t>(usedPositions.size());
+      usedPositions.push_back(positions[index]);
+      if (!normals.empty()) usedNormals.push_back(normals[index]);
+    }
+    index = remap[index];
+  }
+  positions = std::move(usedPositions);
+  normals = std::move(usedNormals);
+}
+
 bool Scene::importOBJ(const Vector& offset, const std::string fileName,
-                      const double scale, const Material& material) {
+                      const double scale, const Material& material,
+                      int lodLevels) {
+  if (lodLevels < 0) {
+    throw std::invalid_argument("Level of detail count cannot be negative");
+  }
   std::ifstream file(fileName);
   if (!file.is_open()) {
     std::cerr << "Error: file does not exist!";
@@ -38,23 +69,23 @@ bool Scene::importOBJ(const Vector& offset, const std::string fileName,
   std::vector<std::string> commandList;
   std::vector<Vector> vertexList;
   std::vector<Vector> normalList;
-  std::vector<Vector> faceVertices;
-  std::vector<Vector> faceNormals;
+  std::vector<std::string> faceBlock;
+  std::vector<uint32_t> faceIndices;
   double x;
   double y;
   double z;
   int i;
-  std::vector<std::string> faceBlock;
   int vertexIndex;
   int normalIndex;
   int splitVertex;
-  Vector v1;
-  Vector v2;
-  Vector v3;
-  Vector n1;
-  Vector n2;
-  Vector n3;
-  Vector zero;
+
+  // Mesh buffers with one vertex per distinct (position, normal) pair
+  std::vector<Vector> positions;
+  std::vector<Vector> normals;
+  std::vector<uint32_t> indices;      // Three per triangle
+  std::vector<uint32_t> quadIndices;  // Four per quad
+  std::unordered_map<uint64_t, uint32_t> meshVertices;
+  bool hasNormals = false;
 
   while (std::getline(file, currentLine)) {
     // Skip empty lines or lines with '#' comments
@@ -72,60 +103,90 @@ bool Scene::importOBJ(const Vector& offset, const std::string fileName,
       vertexList.push_back(Vector(x, y, z));
 
     } else if (commandList[0] == "vn") {
-      // normal vertex??? idk
+      // vertex normal
       x = std::stod(commandList[1]);
       y = std::stod(commandList[2]);
       z = std::stod(commandList[3]);
       normalList.push_back(Vector(x, y, z));
 
     } else if (commandList[0] == "f") {
-      // Gets all vertices in the current face and load them into faceVertices
-      faceVertices.clear();
-      faceNormals.clear();
+      // Gets mesh vertex indices of all corners of the current face
+      faceIndices.clear();
 
       for (i = 1; (size_t)i < commandList.size(); i++) {
         faceBlock = splitByChar(commandList[i], '/');
 
-        // add the current vertex to the list of vertices for this face
         vertexIndex = std::stoi(faceBlock[0]);
-        faceVertices.push_back(vertexList[vertexIndex - 1]);
-
-        // if there is a normal vector defined, add it to the list
-        if (faceBlock.size() > 2) {
-          if (!faceBlock[2]
-                   .empty()) {  // put this in its own thing cuz idk in which
-                                // order multi-parameter ifs are calculated, and
-                                // just want to potentially avoid it trying to
-                                // index the faceBlock if it isn't sure it has
-                                // three strings
-            normalIndex = std::stoi(faceBlock[2]);
-            faceNormals.push_back(normalList[normalIndex - 1]);
+
+        // Normal index is the third field if present (0 if none)
+        normalIndex = 0;
+        if (faceBlock.size() > 2 && !faceBlock[2].empty()) {
+          normalIndex = std::stoi(faceBlock[2]);
+        }
+
+        // Reuse mesh vertex if this position/normal pair was seen before
+        const uint64_t key = (static_cast<uint64_t>(vertexIndex) << 32) |
+                             static_cast<uint32_t>(normalIndex);
+        auto [entry, isNew] = meshVertices.try_emplace(
+            key, static_cast<uint32_t>(positions.size()));
+        if (isNew) {
+          positions.push_back(vertexList[vertexIndex - 1] * scale + offset);
+          if (normalIndex > 0) {
+            normals.push_back(normalList[normalIndex - 1]);
+            hasNormals = true;
+          } else {
+            normals.push_back(Vector());  // placeholder zero normal
           }
-        } else {
-          faceNormals.push_back(Vector());  // placeholder zero normal
         }
+        faceIndices.push_back(entry->second);
       }
 
-      // splits the polygonal face into triangles
-      for (splitVertex = 2; (size_t)splitVertex < faceVertices.size();
+      // Quads are kept whole unless they are to be simplified, which works on
+      // triangles; larger polygons are split into a fan of triangles
+      if (faceIndices.size() == 4 && lodLevels == 0) {
+        quadIndices.insert(quadIndices.end(), faceIndices.begin(),
+                           faceIndices.end());
+        continue;
+      }
+      for (splitVertex = 2; (size_t)splitVertex < faceIndices.size();
            splitVertex++) {
-        // Load triangle vertices and normals
-        v1 = faceVertices[0] * scale + offset;
-        v2 = faceVertices[splitVertex - 1] * scale + offset;
-        v3 = faceVertices[splitVertex] * scale + offset;
-
-        n1 = faceNormals[0];
-        n2 = faceNormals[splitVertex - 1];
-        n3 = faceNormals[splitVertex];
-
-        // If any normal is zero, don't use face normals
-        if (n1 == zero || n2 == zero || n3 == zero) {
-          addTriangle(v1, v2, v3, material);
-        } else {
-          addTriangle(v1, v2, v3, n1, n2, n3, material);
-        }
+        indices.push_back(faceIndices[0]);
+        indices.push_back(faceIndices[splitVertex - 1]);
+        indices.push_back(faceIndices[splitVertex]);
       }
     }
   }
+
+  // Triangles with a zero vertex normal fall back to their face normal
+  if (!hasNormals) normals.clear();
+  if (lodLevels == 0) {
+    // Files of only triangles or only quads keep their vertex buffer as is
+    if (quadIndices.empty()) {
+      if (!indices.empty()) {
+        addMesh(std::move(positions), std::move(normals), std::move(indices),
+                material);
+      }
+    } else if (indices.empty()) {
+      addQuadMesh(std::move(positions), std::move(normals),
+                  std::move(quadIndices), material);
+    } else {
+      std::vector<Vector> quadPositions = positions;
+      std::vector<Vector> quadNormals = normals;
+      compactVertices(positions, normals, indices);
+      compactVertices(quadPositions, quadNormals, quadIndices);
+      addMesh(std::move(positions), std::move(normals), std::move(indices),
+              material);
+      addQuadMesh(std::move(quadPositions), std::move(quadNormals),
+                  std::move(quadIndices), material);
+    }
+    return true;
+  }
+  if (indices.empty()) return true;
+
+  // Simplified levels live in a prototype the mesh is instanced from
+  Scene mesh(0, 0, 0);
+  mesh.addMesh(std::move(positions), std::move(normals), std::move(indices),
+               material);
+  addInstance(std::make_shared<const Prototype>(mesh, lodLevels), Transform());
   return true;
 }
@@ -1,13 +1,16 @@
+#include <iostream>
 #include <string>
 
 #include "io/image.hpp"
 #include "math/color.hpp"
 #include "math/vector.hpp"
 #include "renderer/renderer.hpp"
+#include "renderer/tracer.hpp"
+#include "scene/bvh.hpp"
 #include "scene/material.hpp"
 #include "scene/scene.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
   // Set true to demo the obj importer and mesh rendering. False for spheres
   const bool objDemo = false;
 
@@ -51,6 +54,27 @@ int main() {
                     });
   }
 
+  // Print statistics instead of opening the window
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--bvh-stats") {
+      BVH bvh{scene};
+      bvh.getStats().writeJSON(std::cout);
+      return 0;
+    }
+    // Trace one pass and print how often the shadow occluder cache hit
+    if (std::string(argv[i]) == "--shadow-stats") {
+      Tracer tracer{scene};
+      Pixels pixels{scene.getWidth(), scene.getHeight()};
+      tracer.refinePixels(pixels);
+      tracer.wait();
+      const ShadowCacheStats stats = tracer.getShadowCacheStats();
+      std::cout << "shadow rays: " << stats.lookups
+                << ", cache hits: " << stats.hits
+                << ", hit rate: " << stats.hitRate() << std::endl;
+      return 0;
+    }
+  }
+
   // Interactive window where you can move around the camera @ 60 fps
   Renderer renderer{scene, 60};
   renderer.run();
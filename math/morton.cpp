@@ -0,0 +1,40 @@
+#include "morton.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "math/vector.hpp"
+
+// Spread the lower 21 bits of v so there are two zero bits between each
+static uint64_t expandBits(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+// Spread the lower 16 bits of v so there is one zero bit between each
+static uint32_t spreadBits(uint32_t v) {
+  v &= 0xffff;
+  v = (v | v << 8) & 0x00ff00ff;
+  v = (v | v << 4) & 0x0f0f0f0f;
+  v = (v | v << 2) & 0x33333333;
+  v = (v | v << 1) & 0x55555555;
+  return v;
+}
+
+uint64_t mortonCode(const Vector& p) {
+  const double scale = static_cast<double>((1 << 21) - 1);
+  const uint64_t x = static_cast<uint64_t>(std::clamp(p.x(), 0.0, 1.0) * scale);
+  const uint64_t y = static_cast<uint64_t>(std::clamp(p.y(), 0.0, 1.0) * scale);
+  const uint64_t z = static_cast<uint64_t>(std::clamp(p.z(), 0.0, 1.0) * scale);
+  return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+}
+
+uint32_t mortonCode(uint32_t x, uint32_t y) {
+  return (spreadBits(y) << 1) | spreadBits(x);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "math/vector.hpp"
+
+// 63-bit Morton code of a point normalized to [0, 1] on each axis
+// Sorting by it orders points along a Z-order curve, keeping points that are
+// close in space mostly close in the order
+uint64_t mortonCode(const Vector& p);
+
+// 32-bit Morton code of integer grid coordinates below 2^16
+uint32_t mortonCode(uint32_t x, uint32_t y);
@@ -0,0 +1,20 @@
+#include "random.hpp"
+
+#include <stdint.h>
+
+uint32_t pcgHash(uint32_t v) {
+  const uint32_t state = v * 747796405u + 2891336453u;
+  const uint32_t word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+  return (word >> 22) ^ word;
+}
+
+// Each key is hashed together with the hash of the ones before it
+uint32_t randomBits(uint32_t pixel, uint32_t index, uint32_t dimension,
+                    uint32_t seed) {
+  return pcgHash(seed + pcgHash(dimension + pcgHash(index + pcgHash(pixel))));
+}
+
+double randomUnit(uint32_t pixel, uint32_t index, uint32_t dimension,
+                  uint32_t seed) {
+  return randomBits(pixel, index, dimension, seed) * (1.0 / 4294967296.0);
+}
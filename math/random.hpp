@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+// Stateless random numbers: each value depends only on its key, so any
+// sample of any pixel can be recomputed on its own, by any thread or process
+
+// PCG hash of v (Jarzynski and Olano)
+uint32_t pcgHash(uint32_t v);
+
+// Random 32 bits keyed on pixel, sample index, dimension and seed
+uint32_t randomBits(uint32_t pixel, uint32_t index, uint32_t dimension,
+                    uint32_t seed);
+
+// Random value in [0, 1) keyed on pixel, sample index, dimension and seed
+double randomUnit(uint32_t pixel, uint32_t index, uint32_t dimension,
+                  uint32_t seed);
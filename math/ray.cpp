@@ -2,4 +2,9 @@
 
 #include "vector.hpp"
 
-Vector Ray::at(double t) const { return orig + dir * t; }
+template <typename T>
+VectorT<T> RayT<T>::at(T t) const { return orig + dir * t; }
+
+// Precisions used by the renderer
+template class RayT<float>;
+template class RayT<double>;
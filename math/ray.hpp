@@ -3,16 +3,23 @@
 #include "math/vector.hpp"
 
 // Represents a ray in 3D space with an origin and direction
-class Ray {
+template <typename T>
+class RayT {
  public:
-  Vector orig;
-  Vector dir;
+  VectorT<T> orig;
+  VectorT<T> dir;
 
-  Ray(const Vector& origin, const Vector& direction)
+  RayT(const VectorT<T>& origin, const VectorT<T>& direction)
       : orig(origin), dir(direction) {}
 
+  // Convert from another precision
+  template <typename U>
+  explicit RayT(const RayT<U>& other) : orig(other.orig), dir(other.dir) {}
+
   // Returns the point along the ray at distance t from the origin
-  Vector at(double t) const;
+  VectorT<T> at(T t) const;
+
+  ~RayT() = default;
+};
 
-  ~Ray() = default;
-};
\ No newline at end of file
+using Ray = RayT<double>;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include "math/vector.hpp"
+
+// Scalar type of the geometry read during BVH traversal
+// Node bounds and packed triangles are stored in this precision. Build with
+// FLOAT_GEOMETRY=1 to halve their memory traffic and double SIMD width;
+// shading, accumulation and scalar shape tests stay in double.
+#ifdef FLOAT_GEOMETRY
+using Real = float;
+#else
+using Real = double;
+#endif
+
+// Minimum distance secondary rays start off the surface they leave
+// Float geometry needs a gap wider than its rounding error
+constexpr double RAY_OFFSET =
+    std::is_same<Real, float>::value ? 1e-4 : Vector::EPS;
+
+// Distance secondary rays start off the surface at p
+// Double kernels work in world space and Real kernels relative to the BVH
+// origin, so their rounding error grows with the magnitude of the coordinates
+// each one sees. The offset is a few ulps of both, enough to clear that error
+// without lifting rays over occluders right next to the surface.
+inline double rayOffset(const Vector& p, const Vector& origin) {
+  auto maxAbs = [](const Vector& v) {
+    return std::max({std::abs(v.x()), std::abs(v.y()), std::abs(v.z())});
+  };
+  constexpr int ULPS = 8;
+  constexpr double WORLD_ERROR = ULPS * std::numeric_limits<double>::epsilon();
+  constexpr double REAL_ERROR = ULPS * std::numeric_limits<Real>::epsilon();
+  return std::max({RAY_OFFSET, maxAbs(p) * WORLD_ERROR,
+                   maxAbs(p - origin) * REAL_ERROR});
+}
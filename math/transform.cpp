@@ -0,0 +1,138 @@
+#include "transform.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "ray.hpp"
+#include "vector.hpp"
+
+// Product a * b of two affine 3x4 matrices (implicit last row 0 0 0 1)
+static void multiply(const double (&a)[3][4], const double (&b)[3][4],
+                     double (&out)[3][4]) {
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      out[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c];
+    }
+    out[r][3] += a[r][3];
+  }
+}
+
+// Matrix applied to (v, w): w = 1 for points and 0 for directions
+static Vector apply(const double (&mat)[3][4], const Vector& v, double w) {
+  return Vector(mat[0][0] * v.x() + mat[0][1] * v.y() + mat[0][2] * v.z() +
+                    mat[0][3] * w,
+                mat[1][0] * v.x() + mat[1][1] * v.y() + mat[1][2] * v.z() +
+                    mat[1][3] * w,
+                mat[2][0] * v.x() + mat[2][1] * v.y() + mat[2][2] * v.z() +
+                    mat[2][3] * w);
+}
+
+Transform::Transform(const double (&mat)[3][4], const double (&invMat)[3][4]) {
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      m[r][c] = mat[r][c];
+      inv[r][c] = invMat[r][c];
+    }
+  }
+}
+
+Transform::Transform()
+    : Transform({{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}},
+                {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}) {}
+
+// Invert the linear part by cofactors, then undo the translation
+Transform::Transform(const double (&rows)[3][4]) {
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) m[r][c] = rows[r][c];
+  }
+
+  const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                     m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                     m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  if (std::abs(det) < Vector::EPS) {
+    throw std::invalid_argument("Transform must be invertible");
+  }
+  const double invDet = 1.0 / det;
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      // Cofactor of element (c, r), from the cyclic neighbors of each index
+      const int r1 = (c + 1) % 3, r2 = (c + 2) % 3;
+      const int c1 = (r + 1) % 3, c2 = (r + 2) % 3;
+      inv[r][c] = (m[r1][c1] * m[r2][c2] - m[r1][c2] * m[r2][c1]) * invDet;
+    }
+  }
+  for (int r = 0; r < 3; ++r) {
+    inv[r][3] = -(inv[r][0] * m[0][3] + inv[r][1] * m[1][3] +
+                  inv[r][2] * m[2][3]);
+  }
+}
+
+Transform Transform::translate(const Vector& offset) {
+  return Transform({{1, 0, 0, offset.x()},
+                    {0, 1, 0, offset.y()},
+                    {0, 0, 1, offset.z()}},
+                   {{1, 0, 0, -offset.x()},
+                    {0, 1, 0, -offset.y()},
+                    {0, 0, 1, -offset.z()}});
+}
+
+// Scale along each axis; throws std::invalid_argument if any factor is zero
+Transform Transform::scale(const Vector& factors) {
+  return Transform({{factors.x(), 0, 0, 0},
+                    {0, factors.y(), 0, 0},
+                    {0, 0, factors.z(), 0}});
+}
+
+// Rotation about axis through the origin (right-handed, Rodrigues' formula)
+Transform Transform::rotate(const Vector& axis, double degrees) {
+  if (axis.magSq() < Vector::EPS * Vector::EPS) {
+    throw std::invalid_argument("Rotation axis cannot be zero vector");
+  }
+  const Vector a = axis.norm();
+  const double x = a.x(), y = a.y(), z = a.z();
+  const double rad = degrees * M_PI / 180.0;
+  const double c = cos(rad), s = sin(rad), k = 1.0 - c;
+  const double rot[3][4] = {
+      {c + x * x * k, x * y * k - z * s, x * z * k + y * s, 0},
+      {y * x * k + z * s, c + y * y * k, y * z * k - x * s, 0},
+      {z * x * k - y * s, z * y * k + x * s, c + z * z * k, 0}};
+  // Rotations are orthogonal, so the inverse is the transpose
+  double rotInv[3][4];
+  for (int r = 0; r < 3; ++r) {
+    for (int col = 0; col < 3; ++col) rotInv[r][col] = rot[col][r];
+    rotInv[r][3] = 0;
+  }
+  return Transform(rot, rotInv);
+}
+
+Transform Transform::operator*(const Transform& other) const {
+  double mat[3][4], invMat[3][4];
+  multiply(m, other.m, mat);
+  multiply(other.inv, inv, invMat);
+  return Transform(mat, invMat);
+}
+
+Transform Transform::inverse() const { return Transform(inv, m); }
+
+Vector Transform::point(const Vector& p) const { return apply(m, p, 1.0); }
+
+Vector Transform::vector(const Vector& v) const { return apply(m, v, 0.0); }
+
+// Rows of the inverse transpose are the columns of the inverse
+Vector Transform::normal(const Vector& n) const {
+  return Vector(inv[0][0] * n.x() + inv[1][0] * n.y() + inv[2][0] * n.z(),
+                inv[0][1] * n.x() + inv[1][1] * n.y() + inv[2][1] * n.z(),
+                inv[0][2] * n.x() + inv[1][2] * n.y() + inv[2][2] * n.z());
+}
+
+double Transform::scaleFactor() const {
+  const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                     m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                     m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  return std::cbrt(std::abs(det));
+}
+
+// Direction is not renormalized, so the ray parameter t is unchanged
+Ray Transform::toObject(const Ray& ray) const {
+  return Ray(apply(inv, ray.orig, 1.0), apply(inv, ray.dir, 0.0));
+}
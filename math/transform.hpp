@@ -0,0 +1,40 @@
+#pragma once
+
+#include "math/ray.hpp"
+#include "math/vector.hpp"
+
+// Affine transform stored as a 3x4 matrix: linear part and translation
+// The inverse is kept alongside, so rays can be taken into object space and
+// normals out of it without inverting per use
+class Transform {
+ private:
+  double m[3][4];    // Object to world
+  double inv[3][4];  // World to object
+
+  Transform(const double (&mat)[3][4], const double (&invMat)[3][4]);
+
+ public:
+  // Identity
+  Transform();
+  // Rows of the 3x4 matrix; throws std::invalid_argument if not invertible
+  explicit Transform(const double (&rows)[3][4]);
+
+  static Transform translate(const Vector& offset);
+  static Transform scale(const Vector& factors);
+  static Transform rotate(const Vector& axis, double degrees);
+
+  // Transform that applies other first, then this
+  Transform operator*(const Transform& other) const;
+  Transform inverse() const;
+
+  Vector point(const Vector& p) const;
+  Vector vector(const Vector& v) const;
+  // Normal transformed by the inverse transpose (not normalized)
+  Vector normal(const Vector& n) const;
+  // Ray in object space; distances along it match those of the world ray
+  Ray toObject(const Ray& ray) const;
+  // Uniform scale with the same effect on volume
+  double scaleFactor() const;
+
+  ~Transform() = default;
+};
@@ -7,80 +7,92 @@
 #include <iostream>
 
 // Add two vectors
-Vector Vector::add(const Vector& other) const {
-  return Vector(_x + other._x, _y + other._y, _z + other._z);
+template <typename T>
+VectorT<T> VectorT<T>::add(const VectorT& other) const {
+  return VectorT(_x + other._x, _y + other._y, _z + other._z);
 }
 
 // Subtract two vectors
-Vector Vector::subtract(const Vector& other) const {
-  return Vector(_x - other._x, _y - other._y, _z - other._z);
+template <typename T>
+VectorT<T> VectorT<T>::subtract(const VectorT& other) const {
+  return VectorT(_x - other._x, _y - other._y, _z - other._z);
 }
 
-// Scale vector by a double
-Vector Vector::scale(double scalar) const {
-  return Vector(_x * scalar, _y * scalar, _z * scalar);
+// Scale vector by a scalar
+template <typename T>
+VectorT<T> VectorT<T>::scale(T scalar) const {
+  return VectorT(_x * scalar, _y * scalar, _z * scalar);
 }
 
 // Dot product of two vectors
-double Vector::dot(const Vector& other) const {
+template <typename T>
+T VectorT<T>::dot(const VectorT& other) const {
   return _x * other._x + _y * other._y + _z * other._z;
 }
 
 // Magnitude (length) of a vector
-double Vector::mag() const { return sqrt(this->dot(*this)); }
+template <typename T>
+T VectorT<T>::mag() const { return std::sqrt(this->dot(*this)); }
 
 // Magnitude squared of a vector (dot product with itself)
-double Vector::magSq() const { return this->dot(*this); }
+template <typename T>
+T VectorT<T>::magSq() const { return this->dot(*this); }
 
 // Normalize the vector (make its length 1)
-Vector Vector::norm() const {
-  double magnitude = this->mag();
+template <typename T>
+VectorT<T> VectorT<T>::norm() const {
+  T magnitude = this->mag();
 
   // Return zero vector if magnitude is zero to avoid division by zero
   if (magnitude == 0) {
-    return Vector();
+    return VectorT();
   }
 
-  return this->scale(1.0 / magnitude);
+  return this->scale(1 / magnitude);
 }
 
 // Project this vector onto another vector
-Vector Vector::proj(const Vector& other) const {
+template <typename T>
+VectorT<T> VectorT<T>::proj(const VectorT& other) const {
   // Formula: (this * other / other * other) * other
-  double numerator = this->dot(other);
-  double denominator = other.dot(other);
-  double scalar = numerator / denominator;
+  T numerator = this->dot(other);
+  T denominator = other.dot(other);
+  T scalar = numerator / denominator;
 
   // If the denominator of the scalar is zero, return zero vector
   if (denominator == 0) {
-    return Vector();
+    return VectorT();
   }
 
   return other.scale(scalar);
 }
 
 // Cross product of two vectors
-Vector Vector::cross(const Vector& other) const {
-  return Vector(_y * other._z - _z * other._y, _z * other._x - _x * other._z,
-                _x * other._y - _y * other._x);
+template <typename T>
+VectorT<T> VectorT<T>::cross(const VectorT& other) const {
+  return VectorT(_y * other._z - _z * other._y, _z * other._x - _x * other._z,
+                 _x * other._y - _y * other._x);
 }
 
 // Component-wise minimum
-Vector Vector::min(const Vector& other) const {
-  return Vector(std::min(_x, other._x), std::min(_y, other._y),
-                std::min(_z, other._z));
+template <typename T>
+VectorT<T> VectorT<T>::min(const VectorT& other) const {
+  return VectorT(std::min(_x, other._x), std::min(_y, other._y),
+                 std::min(_z, other._z));
 }
 
 // Component-wise maximum
-Vector Vector::max(const Vector& other) const {
-  return Vector(std::max(_x, other._x), std::max(_y, other._y),
-                std::max(_z, other._z));
+template <typename T>
+VectorT<T> VectorT<T>::max(const VectorT& other) const {
+  return VectorT(std::max(_x, other._x), std::max(_y, other._y),
+                 std::max(_z, other._z));
 }
 
 // ----- Overloaded Operators -----
 
 // Assignment operator
-Vector Vector::operator=(const Vector& other) {
+template <typename T>
+VectorT<T> VectorT<T>::operator=(const VectorT& other) {
   this->_x = other._x;
   this->_y = other._y;
   this->_z = other._z;
@@ -88,28 +100,34 @@ Vector Vector::operator=(const Vector& other) {
 }
 
 // Addition
-Vector Vector::operator+(const Vector& other) const { return this->add(other); }
+template <typename T>
+VectorT<T> VectorT<T>::operator+(const VectorT& other) const {
+  return this->add(other);
+}
 
 // Subtraction
-Vector Vector::operator-(const Vector& other) const {
+template <typename T>
+VectorT<T> VectorT<T>::operator-(const VectorT& other) const {
   return this->subtract(other);
 }
 
 // Negation
-Vector Vector::operator-() const { return Vector(-_x, -_y, -_z); }
+template <typename T>
+VectorT<T> VectorT<T>::operator-() const { return VectorT(-_x, -_y, -_z); }
 
 // Scalar multiplication
-Vector Vector::operator*(double scalar) const { return this->scale(scalar); }
-// Scalar multiplication from the left
-Vector operator*(double scalar, const Vector& vec) { return vec.scale(scalar); }
+template <typename T>
+VectorT<T> VectorT<T>::operator*(T scalar) const { return this->scale(scalar); }
 
 // Scalar division
-Vector Vector::operator/(double scalar) const {
-  return this->scale(1.0 / scalar);
+template <typename T>
+VectorT<T> VectorT<T>::operator/(T scalar) const {
+  return this->scale(1 / scalar);
 }
 
 // Add and assign
-Vector& Vector::operator+=(const Vector& other) {
+template <typename T>
+VectorT<T>& VectorT<T>::operator+=(const VectorT& other) {
   this->_x += other._x;
   this->_y += other._y;
   this->_z += other._z;
@@ -117,7 +135,8 @@ Vector& Vector::operator+=(const Vector& other) {
 }
 
 // Subtract and assign
-Vector& Vector::operator-=(const Vector& other) {
+template <typename T>
+VectorT<T>& VectorT<T>::operator-=(const VectorT& other) {
   this->_x -= other._x;
   this->_y -= other._y;
   this->_z -= other._z;
@@ -125,7 +144,8 @@ Vector& Vector::operator-=(const Vector& other) {
 }
 
 // Scale and assign
-Vector& Vector::operator*=(double scalar) {
+template <typename T>
+VectorT<T>& VectorT<T>::operator*=(T scalar) {
   this->_x *= scalar;
   this->_y *= scalar;
   this->_z *= scalar;
@@ -133,7 +153,8 @@ Vector& Vector::operator*=(double scalar) {
 }
 
 // Divide and assign
-Vector& Vector::operator/=(double scalar) {
+template <typename T>
+VectorT<T>& VectorT<T>::operator/=(T scalar) {
   this->_x /= scalar;
   this->_y /= scalar;
   this->_z /= scalar;
@@ -141,19 +162,27 @@ Vector& Vector::operator/=(double scalar) {
 }
 
 // Dot product
-double Vector::operator*(const Vector& other) const { return this->dot(other); }
+template <typename T>
+T VectorT<T>::operator*(const VectorT& other) const {
+  return this->dot(other);
+}
 
 // Check if two vectors are equal
-bool Vector::operator==(const Vector& other) const {
+template <typename T>
+bool VectorT<T>::operator==(const VectorT& other) const {
   return (std::abs(_x - other._x) < EPS) && (std::abs(_y - other._y) < EPS) &&
          (std::abs(_z - other._z) < EPS);
 }
 
 // Check if two vectors are not equal
-bool Vector::operator!=(const Vector& other) const { return !(*this == other); }
+template <typename T>
+bool VectorT<T>::operator!=(const VectorT& other) const {
+  return !(*this == other);
+}
 
 // Indexing operator
-double Vector::operator[](int index) const {
+template <typename T>
+T VectorT<T>::operator[](int index) const {
   switch (index) {
     case 0:
       return _x;
@@ -162,11 +191,9 @@ double Vector::operator[](int index) const {
     case 2:
       return _z;
   }
-  return 0.0;  // Default case (should not happen)
+  return 0;  // Default case (should not happen)
 }
 
-// Printing: Vector(x, y, z)
-std::ostream& operator<<(std::ostream& os, const Vector& vec) {
-  os << "Vector(" << vec._x << ", " << vec._y << ", " << vec._z << ")";
-  return os;
-}
\ No newline at end of file
+// Precisions used by the renderer
+template class VectorT<float>;
+template class VectorT<double>;
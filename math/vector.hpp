@@ -1,60 +1,82 @@
 #pragma once
 
 #include <iostream>
+#include <type_traits>
 
 // Represents a 3D vector with common vector operations
-class Vector {
+// Templated on scalar type; Vector (double) is used throughout the renderer,
+// while geometry read during traversal may be stored as VectorT<Real>
+template <typename T>
+class VectorT {
  protected:
-  double _x;
-  double _y;
-  double _z;
+  T _x;
+  T _y;
+  T _z;
 
  public:
-  // Small error tolerance for doubleing point comparison
-  static constexpr double EPS = 1e-12;
+  // Small error tolerance for floating point comparison
+  // Single precision can't resolve 1e-12, so float gets a looser one
+  static constexpr T EPS =
+      static_cast<T>(std::is_same<T, float>::value ? 1e-6 : 1e-12);
 
   // Default constructor creates zero vector
-  Vector() : _x(0), _y(0), _z(0) {};
-  Vector(double val) : _x(val), _y(val), _z(val) {};
-  Vector(double x, double y, double z) : _x(x), _y(y), _z(z) {};
+  VectorT() : _x(0), _y(0), _z(0) {};
+  VectorT(T val) : _x(val), _y(val), _z(val) {};
+  VectorT(T x, T y, T z) : _x(x), _y(y), _z(z) {};
+
+  // Convert from another precision
+  template <typename U>
+  explicit VectorT(const VectorT<U>& other)
+      : _x(static_cast<T>(other.x())),
+        _y(static_cast<T>(other.y())),
+        _z(static_cast<T>(other.z())) {}
 
   // Accessors
-  double x() const { return _x; }
-  double y() const { return _y; }
-  double z() const { return _z; }
-
-  Vector add(const Vector& other) const;
-  Vector subtract(const Vector& other) const;
-  Vector scale(double scalar) const;
-  double dot(const Vector& other) const;
-  double mag() const;
-  double magSq() const;
-  Vector norm() const;
-  Vector proj(const Vector& other) const;
-  Vector cross(const Vector& other) const;
-
-  Vector min(const Vector& other) const;
-  Vector max(const Vector& other) const;
+  T x() const { return _x; }
+  T y() const { return _y; }
+  T z() const { return _z; }
+
+  VectorT add(const VectorT& other) const;
+  VectorT subtract(const VectorT& other) const;
+  VectorT scale(T scalar) const;
+  T dot(const VectorT& other) const;
+  T mag() const;
+  T magSq() const;
+  VectorT norm() const;
+  VectorT proj(const VectorT& other) const;
+  VectorT cross(const VectorT& other) const;
+
+  VectorT min(const VectorT& other) const;
+  VectorT max(const VectorT& other) const;
 
   // Operator overloads
-  Vector operator=(const Vector& other);
-  Vector operator+(const Vector& other) const;
-  Vector operator-(const Vector& other) const;
-  Vector operator-() const;
-  Vector operator*(double scalar) const;
-  double operator*(const Vector& other) const;
-  Vector operator/(double scalar) const;
-  Vector& operator+=(const Vector& other);
-  Vector& operator-=(const Vector& other);
-  Vector& operator*=(double scalar);
-  Vector& operator/=(double scalar);
-  bool operator==(const Vector& other) const;
-  bool operator!=(const Vector& other) const;
-  double operator[](int index) const;
-
-  friend std::ostream& operator<<(std::ostream& os, const Vector& vec);
-
-  ~Vector() = default;
+  VectorT operator=(const VectorT& other);
+  VectorT operator+(const VectorT& other) const;
+  VectorT operator-(const VectorT& other) const;
+  VectorT operator-() const;
+  VectorT operator*(T scalar) const;
+  T operator*(const VectorT& other) const;
+  VectorT operator/(T scalar) const;
+  VectorT& operator+=(const VectorT& other);
+  VectorT& operator-=(const VectorT& other);
+  VectorT& operator*=(T scalar);
+  VectorT& operator/=(T scalar);
+  bool operator==(const VectorT& other) const;
+  bool operator!=(const VectorT& other) const;
+  T operator[](int index) const;
+
+  // Scalar multiplication from the left
+  friend VectorT operator*(T scalar, const VectorT& vec) {
+    return vec.scale(scalar);
+  }
+
+  // Printing: Vector(x, y, z)
+  friend std::ostream& operator<<(std::ostream& os, const VectorT& vec) {
+    os << "Vector(" << vec._x << ", " << vec._y << ", " << vec._z << ")";
+    return os;
+  }
+
+  ~VectorT() = default;
 };
 
-Vector operator*(double scalar, const Vector& vec);
+using Vector = VectorT<double>;
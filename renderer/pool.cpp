@@ -49,6 +49,12 @@ int ThreadPool::numTasks() {
   return static_cast<int>(tasks.size());
 }
 
+// Whether no task is waiting or running
+bool ThreadPool::idle() {
+  std::unique_lock<std::mutex> lock(mtx);
+  return tasks.empty() && active == 0;
+}
+
 // Check if abort flag is set
 bool ThreadPool::shouldAbort() {
   return abortAll.load(std::memory_order_acquire);
@@ -38,6 +38,7 @@ class ThreadPool {
 
   int size() const { return static_cast<int>(workers.size()); }
   int numTasks();
+  bool idle();
 
   bool shouldAbort();
   void wait();
@@ -154,17 +154,12 @@ void Renderer::run() {
       // Clear all tasks in the tracer pool
       tracer.pool.clearTasks();
 
-      // Reset backPixel buffer and tileReady flags
-      std::fill(backPixels.pxColors.begin(), backPixels.pxColors.end(),
-                Color());
-      std::fill(backPixels.pxSamples.begin(), backPixels.pxSamples.end(), 0);
-      for (int y = 0; y < h; ++y) {
-        backPixels.rowReady[y].store(false, std::memory_order_release);
-      }
+      // Reset backPixel buffer and rowReady flags
+      backPixels.clear();
     }
 
     // Refine pixels by tracing more rays if not at max quality
-    if (backPixels.pxSamples[0] < MAX_QUALITY) {
+    if (backPixels.passes < MAX_QUALITY) {
       tracer.refinePixels(backPixels);
     }
 
@@ -0,0 +1,164 @@
+#include "sampler.hpp"
+
+#include <stdint.h>
+
+#include <array>
+#include <cmath>
+#include <memory>
+
+#include "math/random.hpp"
+#include "scene/scene.hpp"
+
+// 2^-32, mapping 32-bit integers to [0, 1)
+static constexpr double UNIT = 1.0 / 4294967296.0;
+
+std::unique_ptr<Sampler> Sampler::create(SamplerType type, int width,
+                                         uint32_t seed) {
+  switch (type) {
+    case SamplerType::STRATIFIED:
+      return std::make_unique<StratifiedSampler>(seed);
+    case SamplerType::SOBOL:
+      return std::make_unique<SobolSampler>(seed);
+    case SamplerType::HALTON:
+      return std::make_unique<HaltonSampler>(seed);
+    case SamplerType::LATTICE:
+      return std::make_unique<LatticeSampler>(width, seed);
+  }
+  return nullptr;
+}
+
+double StratifiedSampler::get(uint32_t pixel, uint32_t index,
+                              uint32_t dimension) const {
+  const double random = randomUnit(pixel, index, dimension, seed);
+  if (dimension > 1) return random;
+  if (index == 0) return 0.5;
+  const uint32_t a = GRID_SIZE;
+  const uint32_t cell = dimension == 0 ? index % a : (index / a) % a;
+  return (cell + random) / a;
+}
+
+// Direction numbers of the first four Sobol dimensions (Joe and Kuo)
+static std::array<std::array<uint32_t, 32>, 4> sobolDirections() {
+  // Degree, coefficients and initial numbers of each primitive polynomial
+  struct Polynomial {
+    int s;
+    uint32_t a;
+    uint32_t m[3];
+  };
+  static constexpr Polynomial polynomials[3] = {
+      {1, 0, {1, 0, 0}}, {2, 1, {1, 3, 0}}, {3, 1, {1, 3, 1}}};
+
+  std::array<std::array<uint32_t, 32>, 4> v{};
+  for (int k = 0; k < 32; ++k) {
+    v[0][k] = 1u << (31 - k);
+  }
+  for (int d = 1; d < 4; ++d) {
+    const Polynomial& p = polynomials[d - 1];
+    for (int k = 0; k < 32; ++k) {
+      if (k < p.s) {
+        v[d][k] = p.m[k] << (31 - k);
+        continue;
+      }
+      v[d][k] = v[d][k - p.s] ^ (v[d][k - p.s] >> p.s);
+      for (int j = 1; j < p.s; ++j) {
+        if ((p.a >> (p.s - 1 - j)) & 1) v[d][k] ^= v[d][k - j];
+      }
+    }
+  }
+  return v;
+}
+
+static uint32_t reverseBits(uint32_t x) {
+  x = (x << 16) | (x >> 16);
+  x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+  x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+  x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+  x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+  return x;
+}
+
+// Owen scrambling by hashing, after Burley's "Practical Hash-based Owen
+// Scrambling": each bit is flipped depending only on the bits above it
+static uint32_t owenScramble(uint32_t x, uint32_t seed) {
+  x = reverseBits(x);
+  x += seed;
+  x ^= x * 0x6c50b47c;
+  x ^= x * 0xb82f1e52;
+  x ^= x * 0xc7afe638;
+  x ^= x * 0x8d22f6e6;
+  return reverseBits(x);
+}
+
+double SobolSampler::get(uint32_t pixel, uint32_t index,
+                         uint32_t dimension) const {
+  static const std::array<std::array<uint32_t, 32>, 4> directions =
+      sobolDirections();
+
+  // Scrambling the index gives each pixel its own order of the points, while
+  // every aligned power-of-two block of samples still maps onto one
+  const uint32_t group = randomBits(pixel, 0, dimension / 4, seed);
+  index = owenScramble(index, group);
+
+  const std::array<uint32_t, 32>& v = directions[dimension % 4];
+  uint32_t x = 0;
+  for (int k = 0; k < 32; ++k) {
+    x ^= v[k] & (0u - ((index >> k) & 1));
+  }
+  return owenScramble(x, pcgHash(group + dimension % 4 + 1)) * UNIT;
+}
+
+// Bases of the Halton dimensions, reused with new shifts past the last
+static constexpr uint32_t PRIMES[] = {2,  3,  5,  7,  11, 13, 17, 19,
+                                      23, 29, 31, 37, 41, 43, 47, 53};
+static constexpr uint32_t PRIME_COUNT = sizeof(PRIMES) / sizeof(PRIMES[0]);
+
+// Digits of index in base mirrored around the radix point
+static double radicalInverse(uint32_t index, uint32_t base) {
+  const double invBase = 1.0 / base;
+  double factor = invBase;
+  double result = 0.0;
+  while (index > 0) {
+    result += (index % base) * factor;
+    index /= base;
+    factor *= invBase;
+  }
+  return result;
+}
+
+// Wrap x + shift back into [0, 1)
+static double rotate(double x, double shift) {
+  x += shift;
+  return x >= 1.0 ? x - 1.0 : x;
+}
+
+double HaltonSampler::get(uint32_t pixel, uint32_t index,
+                          uint32_t dimension) const {
+  const double shift = randomUnit(pixel, 0, dimension, seed);
+  return rotate(radicalInverse(index, PRIMES[dimension % PRIME_COUNT]), shift);
+}
+
+// Generating vector of the lattice (Cools, Kuo and Nuyens), reused with new
+// shifts past the last dimension
+static constexpr uint32_t LATTICE[] = {1,      182667, 469891, 498753,
+                                       110745, 446247, 250185, 118627};
+static constexpr uint32_t LATTICE_DIMENSIONS =
+    sizeof(LATTICE) / sizeof(LATTICE[0]);
+
+LatticeSampler::LatticeSampler(int w, uint32_t s)
+    : Sampler(s), width(w), offset(randomUnit(0, 0, 0, s)) {}
+
+double LatticeSampler::get(uint32_t pixel, uint32_t index,
+                           uint32_t dimension) const {
+  // Interleaved gradient noise (Jimenez), stepped by the golden ratio for
+  // each further dimension and offset for the seed
+  auto frac = [](double v) { return v - std::floor(v); };
+  const double px = pixel % width, py = pixel / width;
+  const double shift =
+      frac(52.9829189 * frac(0.06711056 * px + 0.00583715 * py));
+  const double step = 0.6180339887498949 * dimension + offset;
+
+  // The first 2^k samples of the sequence form a lattice of 2^k points
+  const uint32_t g = LATTICE[dimension % LATTICE_DIMENSIONS];
+  const uint32_t x32 = reverseBits(index) * g;
+  return rotate(x32 * UNIT, frac(shift + step));
+}
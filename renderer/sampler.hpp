@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "scene/scene.hpp"
+
+// Source of sample values in [0, 1), indexed by pixel, sample and dimension
+// Dimensions 0 and 1 place a sample within its pixel; later ones are free for
+// anything else a sample needs, like picking a mesh level of detail
+// Values depend only on their indices and the seed, so renders are
+// reproducible whichever thread traces a pixel
+class Sampler {
+ protected:
+  const uint32_t seed;  // Picks one of many equally good sets of samples
+
+ public:
+  Sampler(uint32_t s) : seed(s) {}
+
+  virtual double get(uint32_t pixel, uint32_t index,
+                     uint32_t dimension) const = 0;
+
+  // Sampler of the given type for images width pixels wide
+  static std::unique_ptr<Sampler> create(SamplerType type, int width,
+                                         uint32_t seed = 0);
+
+  virtual ~Sampler() = default;
+};
+
+// First sample at the pixel center, then one jittered random sample per cell
+// of a 2x2 grid in turn
+class StratifiedSampler final : public Sampler {
+ private:
+  static constexpr int GRID_SIZE = 2;
+
+ public:
+  StratifiedSampler(uint32_t s) : Sampler(s) {}
+
+  double get(uint32_t pixel, uint32_t index, uint32_t dimension) const override;
+};
+
+// Sobol sequence with Owen scrambling and a shuffled order per pixel
+// Every power of two of consecutive samples stratifies dimensions 0 and 1
+// Dimensions come in groups of four, each group scrambled independently
+class SobolSampler final : public Sampler {
+ public:
+  SobolSampler(uint32_t s) : Sampler(s) {}
+
+  double get(uint32_t pixel, uint32_t index, uint32_t dimension) const override;
+};
+
+// Halton sequence, one prime base per dimension, shifted randomly per pixel
+class HaltonSampler final : public Sampler {
+ public:
+  HaltonSampler(uint32_t s) : Sampler(s) {}
+
+  double get(uint32_t pixel, uint32_t index, uint32_t dimension) const override;
+};
+
+// Rank-1 lattice sequence, shifted per pixel by interleaved gradient noise
+// Neighboring pixels get very different shifts, so the remaining error looks
+// like fine blue noise instead of blotches
+class LatticeSampler final : public Sampler {
+ private:
+  const int width;
+  const double offset;  // Shift of all pixels picked by the seed
+
+ public:
+  LatticeSampler(int w, uint32_t s);
+
+  double get(uint32_t pixel, uint32_t index, uint32_t dimension) const override;
+};
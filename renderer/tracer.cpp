@@ -1,22 +1,106 @@
 #include "tracer.hpp"
 
+#include <stddef.h>
+
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cmath>
 #include <limits>
-#include <memory>
-#include <optional>
-#include <random>
+#include <numeric>
+#include <utility>
 #include <vector>
 
 #include "math/camera.hpp"
+#include "math/morton.hpp"
 #include "math/ray.hpp"
+#include "math/real.hpp"
 #include "renderer/pool.hpp"
+#include "scene/instance.hpp"
 #include "scene/light.hpp"
 #include "scene/material.hpp"
 #include "scene/scene.hpp"
 #include "shapes/plane.hpp"
 
+void Pixels::clear() {
+  std::fill(pxSamples.begin(), pxSamples.end(), 0);
+  std::fill(pxColors.begin(), pxColors.end(), Color());
+  std::fill(pxLuma.begin(), pxLuma.end(), 0.0);
+  std::fill(pxLumaSq.begin(), pxLumaSq.end(), 0.0);
+  std::fill(tileDone.begin(), tileDone.end(), 0);
+  for (std::atomic_bool& ready : rowReady) {
+    ready.store(false, std::memory_order_release);
+  }
+  passes = 0;
+}
+
+double Pixels::error(int i) const {
+  const int n = pxSamples[i];
+  if (n < 2) return std::numeric_limits<double>::infinity();
+  const double variance =
+      std::max(0.0, (pxLumaSq[i] - pxLuma[i] * pxLuma[i] / n) / (n - 1));
+  return std::sqrt(variance / n);
+}
+
+// Add one sample of color c to pixel i
+static void addSample(Pixels& pixels, int i, const Color& c) {
+  const double luma = c.clamp().luminance();
+  pixels.pxColors[i] += c;
+  pixels.pxSamples[i]++;
+  pixels.pxLuma[i] += luma;
+  pixels.pxLumaSq[i] += luma * luma;
+}
+
+// Ids start at 1 so a zeroed cache never matches a live tracer
+std::atomic<uint64_t> Tracer::nextId{1};
+
+// Per-thread record of the last primitive found blocking each light
+// Neighboring shading points are usually shadowed by the same primitive, so it
+// is tested first and the BVH is only traversed if it no longer blocks light
+struct ShadowCache {
+  // Tracer the cached primitives belong to
+  uint64_t tracerId = 0;
+  // Per light, last blocking primitive (nullptr if none)
+  std::vector<const PrimRef*> lastOccluder;
+  // Statistics not yet flushed to the tracer
+  uint64_t lookups = 0;
+  uint64_t hits = 0;
+};
+
+static thread_local ShadowCache shadowCache;
+
+// Reset this thread's occluder cache if it was filled by another tracer
+static ShadowCache& shadowCacheFor(uint64_t tracerId, size_t lights) {
+  ShadowCache& cache = shadowCache;
+  if (cache.tracerId != tracerId) {
+    cache.tracerId = tracerId;
+    cache.lastOccluder.assign(lights, nullptr);
+    cache.lookups = 0;
+    cache.hits = 0;
+  }
+  return cache;
+}
+
+// Find the closest hit of ray over planes and the BVH
+bool Tracer::closestHit(const Scene& scene, const Ray& ray,
+                        Hit& closest) const {
+  bool found = false;
+
+  // Check non-bounded shapes normally
+  for (size_t p = 0; p < scene.planes.size(); ++p) {
+    Hit planeHit;
+    const PrimRef prim{PrimRef::PLANE, static_cast<uint32_t>(p), 0};
+    if (scene.intersect(prim, ray, planeHit) && planeHit.t < closest.t) {
+      closest = planeHit;
+      found = true;
+    }
+  }
+
+  // Check bounded shapes using BVH, culling anything behind the planes
+  found |= bvh.traverse(scene, ray, closest);
+  return found;
+}
+
 // Trace a ray through the scene and return the resulting color
 const Color Tracer::traceRay(const Scene& scene, const Ray& ray) const {
   // Iterative implementation: follow reflection bounces using a loop
@@ -24,36 +108,22 @@ const Color Tracer::traceRay(const Scene& scene, const Ray& ray) const {
   double throughput = 1.0;
 
   Ray currentRay = ray;
+  setLodHit(LodHit{});
 
   for (int bounce = 0; bounce < scene.getReflections(); ++bounce) {
     // Check for intersections with all shapes in the scene
-    std::optional<HitInfo> closestHit;
-    double closestT = std::numeric_limits<double>::max();
-
-    // Check non-bounded shapes normally
-    for (const std::unique_ptr<Plane>& shape : scene.planes) {
-      std::optional<HitInfo> hitOpt = shape->intersects(currentRay);
-      if (hitOpt.has_value() && hitOpt->t < closestT) {
-        closestT = hitOpt->t;
-        closestHit.emplace(hitOpt.value());
-      }
-    }
-
-    // Check bounded shapes using BVH
-    bvh.traverse(scene.bndedShapes, currentRay, [&](const HitInfo& hitInfo) {
-      if (hitInfo.t < closestT) {
-        closestT = hitInfo.t;
-        closestHit.emplace(hitInfo);
-      }
-    });
-
-    if (!closestHit.has_value()) {
+    Hit closest;
+    if (!closestHit(scene, currentRay, closest)) {
       // No hit: add background scaled by current throughput and finish
       finalColor += throughput * scene.getBackground();
       break;
     }
 
-    const HitInfo hit = closestHit.value();
+    // Shadow and reflection rays start on this hit's level of detail
+    setLodHit(scene.lodHit(closest));
+
+    // Only the closest hit needs its position, normal and material
+    const HitInfo hit = scene.hitInfo(closest, currentRay);
 
     // Compute local color at hit point
     const Color localColor = computeLighting(scene, hit);
@@ -68,7 +138,8 @@ const Color Tracer::traceRay(const Scene& scene, const Ray& ray) const {
     }
 
     // Compute reflection direction and offset to avoid self intersection
-    const Vector i = hit.pos + hit.normal * Vector::EPS;
+    const Vector i =
+        hit.pos + hit.normal * rayOffset(hit.pos, bvh.getOrigin());
     const Vector d = currentRay.dir;
     const Vector reflectDir = d - 2.0 * d.proj(hit.normal);
 
@@ -85,120 +156,428 @@ const Color Tracer::traceRay(const Scene& scene, const Ray& ray) const {
   return finalColor;
 }
 
+// Ambient part of a material's color (doesn't depend on lights)
+static Color ambientColor(const Scene& scene, const Material& mat) {
+  const double ambFactor = scene.getAmbientLight() * (1 - mat.reflectivity);
+  return mat.color * ambFactor;
+}
+
 // Compute lighting for all lights at the hit point
 // NOTE: does NOT perform recursive reflections
 // Reflection is handled iteratively inside traceRay
 const Color Tracer::computeLighting(const Scene& scene,
                                     const HitInfo& hitInfo) const {
-  // Convenience variables
   // Offset origin slightly to avoid self-intersection
-  const Vector i = hitInfo.pos + hitInfo.normal * Vector::EPS;
-  const Vector d = hitInfo.ray.dir;
+  const Vector i =
+      hitInfo.pos + hitInfo.normal * rayOffset(hitInfo.pos, bvh.getOrigin());
+  Color finalColor =
+      ambientColor(scene, scene.materials[hitInfo.materialIndex]);
+
+  for (size_t l = 0; l < scene.lights.size(); ++l) {
+    if (!occluded(scene, i, l)) {
+      addLight(scene, hitInfo, i, l, finalColor);
+    }
+  }
 
+  return finalColor;
+}
+
+// Whether anything lies between point and light (cast shadow ray toward it)
+// Only hits closer than the light count, so the answer doesn't depend on
+// which occluder the cache happens to hold
+bool Tracer::occluded(const Scene& scene, const Vector& point,
+                      size_t light) const {
+  const Vector toLight = scene.lights[light].position - point;
+  const double distToLight = toLight.mag();
+  const Ray shadowRay(point, toLight / distToLight);
+  auto blocksLight = [distToLight](double t) {
+    return t > Vector::EPS && t < distToLight;
+  };
+
+  for (const Plane& shape : scene.planes) {
+    double t, u, v;
+    if (shape.intersect(shadowRay, t, u, v) && blocksLight(t)) {
+      return true;
+    }
+  }
+
+  // Bounded shapes: cached occluder first, then BVH
+  ShadowCache& cache = shadowCacheFor(id, scene.lights.size());
+  const PrimRef*& occluder = cache.lastOccluder[light];
+  cache.lookups++;
+  Hit shadowHit;
+  if (occluder) {
+    if (scene.intersect(*occluder, shadowRay, shadowHit) &&
+        blocksLight(shadowHit.t)) {
+      cache.hits++;
+      return true;
+    }
+  }
+
+  const PrimRef* hitPrim =
+      bvh.traverseFirstHit(scene, shadowRay, distToLight, shadowHit);
+  if (hitPrim) {
+    occluder = hitPrim;
+    return true;
+  }
+  return false;
+}
+
+// Add the diffuse and specular light reaching point from an unblocked light
+void Tracer::addLight(const Scene& scene, const HitInfo& hitInfo,
+                      const Vector& point, size_t light, Color& color) const {
+  const Vector d = hitInfo.ray.dir;
   const Vector n = hitInfo.normal;
   const Material* mat = &scene.materials[hitInfo.materialIndex];
-
-  // Ambient light contribution (doesn't depend on lights)
   const double ambFactor = scene.getAmbientLight() * (1 - mat->reflectivity);
-  const Color ambient = mat->color * ambFactor;
+  const Light& l = scene.lights[light];
+  const Vector lt = (l.position - point).norm();
+
+  // Diffuse light contribution
+  const double diffFactor =
+      (1 - ambFactor) * (1 - mat->reflectivity) * std::max(0.0, n * lt);
+  const Color diffuse = mat->color * l.color * diffFactor;
+
+  // Specular light contribution
+  const Vector h = (lt - d.norm()).norm();
+  const Color specular = mat->specular * mat->specularFactor *
+                         std::pow(std::max(0.0, n * h), mat->shininess) *
+                         l.color;
+
+  // Sum contributions
+  color = color + diffuse + specular;
+}
 
-  Color finalColor = ambient;
+// Rays of one wavefront stage, one array per component so that each stage
+// streams through them in a tight loop
+struct RayQueue {
+  std::vector<double> ox, oy, oz;  // Origins
+  std::vector<double> dx, dy, dz;  // Directions
+  std::vector<int> pixel;          // Pixel of the batch the ray adds color to
+  std::vector<double> throughput;  // Fraction of the ray's color reaching it
+  std::vector<double> dither;      // Level of detail dither of the sample
+  std::vector<LodHit> from;        // Instance hit the ray leaves, if any
+
+  size_t size() const { return pixel.size(); }
+
+  void clear() {
+    ox.clear(), oy.clear(), oz.clear();
+    dx.clear(), dy.clear(), dz.clear();
+    pixel.clear(), throughput.clear(), dither.clear(), from.clear();
+  }
 
-  for (const Light& light : scene.lights) {
-    bool inShadow = false;
+  void push(const Ray& ray, int px, double weight, double lodDither,
+            const LodHit& lodHit) {
+    ox.push_back(ray.orig.x()), oy.push_back(ray.orig.y());
+    oz.push_back(ray.orig.z()), dx.push_back(ray.dir.x());
+    dy.push_back(ray.dir.y()), dz.push_back(ray.dir.z());
+    pixel.push_back(px), throughput.push_back(weight);
+    dither.push_back(lodDither), from.push_back(lodHit);
+  }
 
-    // Shadow check (cast shadow ray toward light)
-    for (const std::unique_ptr<Plane>& shape : scene.planes) {
-      const Vector toLight = light.position - i;
-      const Ray shadowRay(i, toLight);
-      std::optional<HitInfo> shadowHitOpt = shape->intersects(shadowRay);
+  Ray ray(size_t i) const {
+    return Ray(Vector(ox[i], oy[i], oz[i]), Vector(dx[i], dy[i], dz[i]));
+  }
+};
+
+// Per-thread buffers of a wavefront batch, kept to reuse their allocations
+struct Wavefront {
+  RayQueue rays;             // Rays to extend this bounce
+  RayQueue next;             // Reflection rays for the next bounce
+  std::vector<Hit> hits;     // Closest hit per ray (t stays max on a miss)
+  std::vector<size_t> hitRay;       // Ray of each shaded hit
+  std::vector<HitInfo> hitInfos;    // Surface of each shaded hit
+  std::vector<double> sx, sy, sz;   // Offset shadow ray origin per shaded hit
+  std::vector<Color> local;         // Color leaving each shaded hit
+  std::vector<uint32_t> shadowHit;    // Shaded hit of each shadow ray
+  std::vector<uint32_t> shadowLight;  // Light of each shadow ray
+  std::vector<Color> colors;        // Color gathered per pixel of the batch
+};
+
+static thread_local Wavefront wavefront;
+
+// Nanoseconds since start
+static uint64_t elapsedNanos(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
 
-      if (shadowHitOpt.has_value()) {
-        const double distToLightSq = toLight.magSq();
-        const double tSq = shadowHitOpt->t * shadowHitOpt->t;
-        if (tSq < distToLightSq && shadowHitOpt->t > Vector::EPS) {
-          inShadow = true;
-          break;
-        }
+// Trace one sample for every selected pixel stage by stage: generate camera
+// rays, extend them to their closest hit, shade the hits and queue shadow
+// rays, then trace the shadow rays. Reflection rays form the next bounce's
+// queue. Colors match traceRay exactly.
+void Tracer::traceWavefront(Pixels& pixels, const std::vector<int>& selected,
+                            const Camera& camera) {
+  enum { GENERATE, EXTEND, SHADE, SHADOW };
+  const int w = scene.getWidth();
+  const int h = scene.getHeight();
+  const int count = static_cast<int>(selected.size());
+  Wavefront& wf = wavefront;
+  uint64_t rays[4] = {}, nanos[4] = {};
+
+  // Generate: one camera ray per pixel
+  auto start = std::chrono::steady_clock::now();
+  wf.rays.clear();
+  wf.colors.assign(count, Color{0, 0, 0});
+  for (int k = 0; k < count; ++k) {
+    const int i = selected[k];
+    const uint32_t n = pixels.pxSamples[i];
+    const double x = i % w + sampler->get(i, n, 0);
+    const double y = i / w + sampler->get(i, n, 1);
+    // Mesh levels of detail are blended per sample
+    const double lodDither = sampler->get(i, n, 2);
+    wf.rays.push(camera.ray(x, y, w, h), k, 1.0, lodDither, LodHit{});
+  }
+  rays[GENERATE] += count;
+  nanos[GENERATE] += elapsedNanos(start);
+
+  for (int bounce = 0; bounce < scene.getReflections() && wf.rays.size() > 0;
+       ++bounce) {
+    const RayQueue& queue = wf.rays;
+    const size_t n = queue.size();
+
+    // Extend: closest hit of every ray
+    start = std::chrono::steady_clock::now();
+    wf.hits.assign(n, Hit{});
+    for (size_t r = 0; r < n; ++r) {
+      setLodDither(queue.dither[r]);
+      setLodHit(queue.from[r]);
+      closestHit(scene, queue.ray(r), wf.hits[r]);
+    }
+    rays[EXTEND] += n;
+    nanos[EXTEND] += elapsedNanos(start);
+
+    // Shade: background for misses; ambient light, shadow rays and
+    // reflection rays for hits
+    start = std::chrono::steady_clock::now();
+    wf.next.clear();
+    wf.hitRay.clear();
+    wf.hitInfos.clear();
+    wf.sx.clear(), wf.sy.clear(), wf.sz.clear();
+    wf.local.clear();
+    wf.shadowHit.clear();
+    wf.shadowLight.clear();
+    for (size_t r = 0; r < n; ++r) {
+      const double throughput = queue.throughput[r];
+      if (wf.hits[r].t == std::numeric_limits<double>::max()) {
+        wf.colors[queue.pixel[r]] += throughput * scene.getBackground();
+        continue;
+      }
+
+      const Ray ray = queue.ray(r);
+      const HitInfo hit = scene.hitInfo(wf.hits[r], ray);
+      const Material& mat = scene.materials[hit.materialIndex];
+      const Vector i =
+          hit.pos + hit.normal * rayOffset(hit.pos, bvh.getOrigin());
+
+      const uint32_t shaded = static_cast<uint32_t>(wf.hitRay.size());
+      wf.hitRay.push_back(r);
+      wf.hitInfos.push_back(hit);
+      wf.sx.push_back(i.x()), wf.sy.push_back(i.y()), wf.sz.push_back(i.z());
+      wf.local.push_back(ambientColor(scene, mat));
+      for (size_t l = 0; l < scene.lights.size(); ++l) {
+        wf.shadowHit.push_back(shaded);
+        wf.shadowLight.push_back(static_cast<uint32_t>(l));
+      }
+
+      if (mat.reflectivity <= 0 || throughput * mat.reflectivity <= 0.001) {
+        continue;
+      }
+      const Vector d = ray.dir;
+      const Vector reflectDir = d - 2.0 * d.proj(hit.normal);
+      wf.next.push(Ray(i, reflectDir), queue.pixel[r],
+                   throughput * mat.reflectivity, queue.dither[r],
+                   scene.lodHit(wf.hits[r]));
+    }
+    rays[SHADE] += wf.hitRay.size();
+    nanos[SHADE] += elapsedNanos(start);
+
+    // Shadow: add each light not blocked from its hit, in light order
+    start = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < wf.shadowHit.size(); ++s) {
+      const uint32_t k = wf.shadowHit[s];
+      const Vector i(wf.sx[k], wf.sy[k], wf.sz[k]);
+      setLodDither(queue.dither[wf.hitRay[k]]);
+      setLodHit(scene.lodHit(wf.hits[wf.hitRay[k]]));
+      if (!occluded(scene, i, wf.shadowLight[s])) {
+        addLight(scene, wf.hitInfos[k], i, wf.shadowLight[s], wf.local[k]);
       }
     }
-    // Shadow check for bounded shapes using BVH
-    if (!inShadow) {
-      const Vector toLight = light.position - i;
-      const Ray shadowRay(i, toLight);
-      bvh.traverseFirstHit(
-          scene.bndedShapes, shadowRay, [&](const HitInfo& shadowHit) {
-            const double distToLightSq = toLight.magSq();
-            const double tSq = shadowHit.t * shadowHit.t;
-            if (tSq < distToLightSq && shadowHit.t > Vector::EPS) {
-              inShadow = true;
-            }
-          });
+    for (size_t k = 0; k < wf.hitRay.size(); ++k) {
+      const size_t r = wf.hitRay[k];
+      wf.colors[queue.pixel[r]] += queue.throughput[r] * wf.local[k];
     }
+    rays[SHADOW] += wf.shadowHit.size();
+    nanos[SHADOW] += elapsedNanos(start);
 
-    const Vector lt = (light.position - i).norm();
+    std::swap(wf.rays, wf.next);
+  }
 
-    // Diffuse light contribution
-    Color diffuse;
-    if (!inShadow) {
-      const double diffFactor =
-          (1 - ambFactor) * (1 - mat->reflectivity) * std::max(0.0, n * lt);
-      diffuse = mat->color * light.color * diffFactor;
-    }
+  for (int k = 0; k < count; ++k) {
+    addSample(pixels, selected[k], wf.colors[k]);
+  }
+  for (int s = 0; s < 4; ++s) {
+    stageRays[s].fetch_add(rays[s], std::memory_order_relaxed);
+    stageNanos[s].fetch_add(nanos[s], std::memory_order_relaxed);
+  }
+}
 
-    // Specular light contribution
-    Color specular;
-    if (!inShadow) {
-      const Vector h = (lt - d.norm()).norm();
-      specular = mat->specular * mat->specularFactor *
-                 std::pow(std::max(0.0, n * h), mat->shininess) * light.color;
-    }
+// Side of the square tiles each pass is split into, rounded up to whole
+// convergence tiles. Unless the scene sets it, the largest power of two up to
+// MAX_TILE_SIZE that still gives every worker TILES_PER_THREAD tiles, so a
+// slow tile of reflective geometry cannot leave the others idle.
+int Tracer::tileSize() const {
+  const int tile = Pixels::TILE_SIZE;
+  if (scene.getTileSize() > 0) {
+    return (scene.getTileSize() + tile - 1) / tile * tile;
+  }
 
-    // Sum contributions
-    finalColor = finalColor + diffuse + specular;
+  const int w = scene.getWidth();
+  const int h = scene.getHeight();
+  int size = MAX_TILE_SIZE;
+  while (size > tile && ((w + size - 1) / size) * ((h + size - 1) / size) <
+                            TILES_PER_THREAD * pool.size()) {
+    size /= 2;
   }
+  return size;
+}
 
-  return finalColor;
+// Append the pixels of rectangle [x0, x1) x [y0, y1) that need another
+// sample, tile by tile. Without a noise threshold that is every pixel;
+// otherwise pixels stop once their error is below it, and tiles with no pixel
+// left are not looked at again. The rectangle must start on a tile corner.
+void Tracer::selectPixels(Pixels& pixels, int x0, int y0, int x1, int y1,
+                          std::vector<int>& selected) const {
+  const int w = scene.getWidth();
+  const int tile = Pixels::TILE_SIZE;
+  const double threshold = scene.getNoiseThreshold();
+
+  for (int ty = y0; ty < y1; ty += tile) {
+    for (int tx = x0; tx < x1; tx += tile) {
+      uint8_t& done = pixels.tileDone[ty / tile * pixels.tilesX + tx / tile];
+      if (done) continue;
+
+      const size_t before = selected.size();
+      for (int y = ty; y < std::min(ty + tile, y1); ++y) {
+        for (int x = tx; x < std::min(tx + tile, x1); ++x) {
+          const int i = y * w + x;
+          if (threshold <= 0 || pixels.pxSamples[i] < MIN_SAMPLES ||
+              pixels.error(i) > threshold) {
+            selected.push_back(i);
+          }
+        }
+      }
+      done = selected.size() == before;
+    }
+  }
 }
 
-// Refines pixels object in place by adding one more sample per pixel
+// Refines pixels object in place by adding one more sample to every pixel
+// that has not converged yet
+// Does nothing while the previous pass is still being traced, since two
+// passes must never sample the same pixel at once
 void Tracer::refinePixels(Pixels& pixels) {
-  if (pool.numTasks() > scene.getHeight()) {
+  if (!pool.idle()) {
     return;
   }
 
   const int w = scene.getWidth();
   const int h = scene.getHeight();
-  const Camera& camera = scene.getCamera();
-
-  for (int row = 0; row < h; ++row) {
-    pool.enqueue([this, &pixels, camera, row, w, h]() {
-      thread_local std::mt19937 rng(std::random_device{}());
-      thread_local std::uniform_real_distribution<double> dist(-0.5, 0.5);
-
-      for (int x = 0; x < w; ++x) {
-        const int i = row * w + x;
-        int oldSamples = pixels.pxSamples[i];
-
-        double xOffset = 0.5, yOffset = 0.5;
-        if (oldSamples > 0) {
-          const int a = ANTI_ALIAS_GRID_SIZE;
-          const double xQuad = ((oldSamples % a + 0.5) / a);
-          const double yQuad = (((oldSamples / a) % a + 0.5) / a);
-          xOffset = xQuad + dist(rng) / a;
-          yOffset = yQuad + dist(rng) / a;
-        }
+  // The camera may move while the pass is traced, so tasks get a copy
+  const Camera camera = scene.getCamera();
+  const LodView view = scene.lodView();
+  pixels.passes++;
+
+  // Square tiles in Morton order, so tasks that run close together in time
+  // trace neighboring pixels and share BVH nodes in cache
+  const int tile = tileSize();
+  const int tilesX = (w + tile - 1) / tile;
+  const int tilesY = (h + tile - 1) / tile;
+  std::vector<uint32_t> order(tilesX * tilesY);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [tilesX](uint32_t a, uint32_t b) {
+    return mortonCode(a % tilesX, a / tilesX) <
+           mortonCode(b % tilesX, b / tilesX);
+  });
+
+  // Wavefront tasks take consecutive tiles until they fill a batch
+  const bool wave = scene.getTraceMode() == TraceMode::WAVEFRONT;
+  const size_t perTask =
+      wave ? std::max(1, WAVEFRONT_BATCH / (tile * tile)) : 1;
+
+  for (size_t first = 0; first < order.size(); first += perTask) {
+    std::vector<uint32_t> tiles(
+        order.begin() + first,
+        order.begin() + std::min(order.size(), first + perTask));
+    pool.enqueue([this, &pixels, camera, view, tiles, tile, tilesX, w, h,
+                  wave]() {
+      setLodView(view);
+      thread_local std::vector<int> selected;
+      selected.clear();
+      for (const uint32_t t : tiles) {
+        const int x0 = t % tilesX * tile;
+        const int y0 = t / tilesX * tile;
+        selectPixels(pixels, x0, y0, std::min(x0 + tile, w),
+                     std::min(y0 + tile, h), selected);
+      }
 
-        Ray ray = camera.ray(x + xOffset, row + yOffset, w, h);
-        Color c = traceRay(scene, ray);
+      if (wave) {
+        traceWavefront(pixels, selected, camera);
+      } else {
+        for (const int i : selected) {
+          const uint32_t n = pixels.pxSamples[i];
+          const double x = i % w + sampler->get(i, n, 0);
+          const double y = i / w + sampler->get(i, n, 1);
+
+          // Mesh levels of detail are blended per sample
+          setLodDither(sampler->get(i, n, 2));
+          Ray ray = camera.ray(x, y, w, h);
+          addSample(pixels, i, traceRay(scene, ray));
+        }
+      }
+      flushShadowCacheStats();
 
-        pixels.pxColors[i] += c;
-        pixels.pxSamples[i]++;
+      // Mark rows as ready
+      for (const uint32_t t : tiles) {
+        const int y0 = t / tilesX * tile;
+        for (int y = y0; y < std::min(y0 + tile, h); ++y) {
+          pixels.rowReady[y].store(true, std::memory_order_release);
+        }
       }
-      // Mark row as ready
-      pixels.rowReady[row].store(true, std::memory_order_release);
     });
   }
 }
 
-void Tracer::wait() { pool.wait(); }
\ No newline at end of file
+void Tracer::wait() { pool.wait(); }
+
+// Move this thread's shadow cache statistics into the tracer totals
+void Tracer::flushShadowCacheStats() {
+  ShadowCache& cache = shadowCache;
+  if (cache.tracerId != id) return;
+  shadowLookups.fetch_add(cache.lookups, std::memory_order_relaxed);
+  shadowHits.fetch_add(cache.hits, std::memory_order_relaxed);
+  cache.lookups = 0;
+  cache.hits = 0;
+}
+
+// Get shadow cache statistics for all rows traced so far
+ShadowCacheStats Tracer::getShadowCacheStats() const {
+  ShadowCacheStats stats;
+  stats.lookups = shadowLookups.load(std::memory_order_relaxed);
+  stats.hits = shadowHits.load(std::memory_order_relaxed);
+  return stats;
+}
+// Get per-stage totals of all wavefront batches traced so far
+WavefrontStats Tracer::getWavefrontStats() const {
+  WavefrontStats stats;
+  stats.cameraRays = stageRays[0].load(std::memory_order_relaxed);
+  stats.extendRays = stageRays[1].load(std::memory_order_relaxed);
+  stats.shadedHits = stageRays[2].load(std::memory_order_relaxed);
+  stats.shadowRays = stageRays[3].load(std::memory_order_relaxed);
+  stats.generateSeconds = stageNanos[0].load(std::memory_order_relaxed) * 1e-9;
+  stats.extendSeconds = stageNanos[1].load(std::memory_order_relaxed) * 1e-9;
+  stats.shadeSeconds = stageNanos[2].load(std::memory_order_relaxed) * 1e-9;
+  stats.shadowSeconds = stageNanos[3].load(std::memory_order_relaxed) * 1e-9;
+  return stats;
+}
@@ -1,27 +1,45 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <atomic>
-#include <functional>
-#include <iostream>
+#include <memory>
 #include <thread>
 #include <vector>
 
+#include "math/camera.hpp"
 #include "math/color.hpp"
+#include "math/ray.hpp"
 #include "math/vector.hpp"
 #include "pool.hpp"
+#include "renderer/sampler.hpp"
 #include "scene/bvh.hpp"
 #include "shapes/shape.hpp"
 
 // Forward declaration
-class Ray;
 class Scene;
 
 struct Pixels {
+  static constexpr int TILE_SIZE = 8;  // Side of the tiles sampling stops in
+
   std::vector<int> pxSamples;   // Number of samples per pixel
   std::vector<Color> pxColors;  // Accumalated color per pixel (not averaged)
+  std::vector<double> pxLuma;    // Sum of sample luminance per pixel
+  std::vector<double> pxLumaSq;  // Sum of squared sample luminance per pixel
   std::vector<std::atomic_bool> rowReady;  // Marks if row is ready for display
+  int tilesX;                       // Tiles per row of pixels
+  std::vector<uint8_t> tileDone;    // Marks tiles whose pixels all converged
+  int passes = 0;                   // Sampling passes queued so far
 
-  Pixels(int w, int h) : pxSamples(w * h), pxColors(w * h), rowReady(h) {
+  Pixels(int w, int h)
+      : pxSamples(w * h),
+        pxColors(w * h),
+        pxLuma(w * h),
+        pxLumaSq(w * h),
+        rowReady(h),
+        tilesX((w + TILE_SIZE - 1) / TILE_SIZE),
+        tileDone(tilesX * ((h + TILE_SIZE - 1) / TILE_SIZE)) {
     for (int y = 0; y < h; ++y) {
       rowReady[y].store(false, std::memory_order_release);
     }
@@ -29,38 +47,83 @@ struct Pixels {
   Pixels(const Pixels& px) = default;
   Pixels& operator=(const Pixels& other) = default;
 
+  // Discard all samples
+  void clear();
+  // Standard error of the mean luminance of pixel i
+  double error(int i) const;
+
   ~Pixels() = default;
 };
 
+// Hit rate of the per-thread shadow occluder cache
+struct ShadowCacheStats {
+  uint64_t lookups = 0;  // Shadow rays tested against bounded shapes
+  uint64_t hits = 0;     // Shadow rays resolved by the cached occluder
+
+  double hitRate() const {
+    return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+  }
+};
+
+// Work done and time spent by each stage of wavefront tracing
+struct WavefrontStats {
+  uint64_t cameraRays = 0;  // Rays generated from the camera
+  uint64_t extendRays = 0;  // Rays tested for their closest hit
+  uint64_t shadedHits = 0;  // Closest hits shaded
+  uint64_t shadowRays = 0;  // Shadow rays tested toward lights
+  double generateSeconds = 0.0;
+  double extendSeconds = 0.0;
+  double shadeSeconds = 0.0;
+  double shadowSeconds = 0.0;
+};
+
 // Responsible for tracing rays through the scene and computing pixel colors
 class Tracer {
  private:
-  static constexpr int ANTI_ALIAS_GRID_SIZE = 2;
+  static constexpr int WAVEFRONT_BATCH = 4096;  // Rays per wavefront batch
+  static constexpr int MIN_SAMPLES = 8;  // Samples before a pixel can stop
+  static constexpr int MAX_TILE_SIZE = 64;     // Largest automatic tile side
+  static constexpr int TILES_PER_THREAD = 8;   // Automatic tiling target
+  static std::atomic<uint64_t> nextId;  // Source of unique tracer ids
   const Color traceRay(const Scene& scene, const Ray& ray) const;
   const Color computeLighting(const Scene& scene, const HitInfo& hitInfo) const;
+  bool closestHit(const Scene& scene, const Ray& ray, Hit& closest) const;
+  bool occluded(const Scene& scene, const Vector& point, size_t light) const;
+  void addLight(const Scene& scene, const HitInfo& hitInfo, const Vector& point,
+                size_t light, Color& color) const;
+  int tileSize() const;
+  void selectPixels(Pixels& pixels, int x0, int y0, int x1, int y1,
+                    std::vector<int>& selected) const;
+  void traceWavefront(Pixels& pixels, const std::vector<int>& selected,
+                      const Camera& camera);
+  void flushShadowCacheStats();
   const Scene& scene;
-  BVH bvh;
   ThreadPool pool{std::thread::hardware_concurrency()};
+  BVH bvh;
+  const uint64_t id;  // Invalidates per-thread caches left by other tracers
+  const std::unique_ptr<Sampler> sampler;  // Sample positions within pixels
+  std::atomic<uint64_t> shadowLookups{0};
+  std::atomic<uint64_t> shadowHits{0};
+  // Wavefront totals: rays per stage, then nanoseconds per stage
+  std::atomic<uint64_t> stageRays[4] = {};
+  std::atomic<uint64_t> stageNanos[4] = {};
 
  public:
-  Tracer(Scene& sc) : scene(sc), bvh(sc) {
-    std::function<void(const std::vector<BVHNode>&, int, int)> printNode =
-        [&](const std::vector<BVHNode>& nodes, int index, int depth) {
-          if (index < 0) return;
-          const auto& n = nodes[index];
-          for (int i = 0; i < depth; ++i) std::cout << "  ";
-          std::cout << "Node " << index << ": " << "bounds=[" << n.bounds.min
-                    << " - " << n.bounds.max << ", shapes=" << n.shapeCount
-                    << "\n";
-          printNode(nodes, n.left, depth + 1);
-          printNode(nodes, n.right, depth + 1);
-        };
-    // Uncomment to print BVH structure
-    // printNode(bvh.getNodes(), 0, 0);
+  // Reorders sc's primitives to match the BVH
+  Tracer(Scene& sc)
+      : scene(sc),
+        bvh(sc, &pool),
+        id(nextId++),
+        sampler(Sampler::create(sc.getSamplerType(), sc.getWidth(),
+                                sc.getSeed())) {
+    bvh.reorderScene(sc);
   }
 
   void refinePixels(Pixels& pixels);
   void wait();
+  ShadowCacheStats getShadowCacheStats() const;
+  WavefrontStats getWavefrontStats() const;
+  const BVH& getBVH() const { return bvh; }
 
   ~Tracer() = default;
 
@@ -1,15 +1,74 @@
 #include "bvh.hpp"
 
+#include <stdint.h>
+
 #include <algorithm>
+#include <chrono>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <numeric>
-#include <optional>
+#include <thread>
 
+#include "math/morton.hpp"
 #include "math/vector.hpp"
+#include "renderer/pool.hpp"
+#include "shapes/mesh.hpp"
+#include "shapes/sphere.hpp"
+#include "shapes/triangle.hpp"
+
+#ifdef WATERTIGHT_TRIANGLES
+// Packed leaves use Möller–Trumbore, so watertight builds test one at a time
+static constexpr bool PACK_TRIANGLES = false;
+#else
+static constexpr bool PACK_TRIANGLES = true;
+#endif
+
+// Pack a primitive can be stored in (NONE if it is tested on its own)
+static PackType packTypeOf(const PrimRef& prim) {
+  switch (prim.type) {
+    case PrimRef::TRIANGLE:
+    case PrimRef::MESH_TRIANGLE:
+      return PACK_TRIANGLES ? PackType::TRIANGLES : PackType::NONE;
+    case PrimRef::SPHERE:
+      return PackType::SPHERES;
+    default:
+      return PackType::NONE;
+  }
+}
 
-// Forward declaration
-class Ray;
+// Number of packs needed to hold count primitives
+// Both pack types fill one AVX register per coordinate, so they are equally
+// wide and leaves of either type share one size limit and cost
+static_assert(SpherePack::WIDTH == TrianglePack::WIDTH,
+              "Pack types must have the same width");
+static int packCount(int count) {
+  return (count + TrianglePack::WIDTH - 1) / TrianglePack::WIDTH;
+}
+
+// Index in prims of the nearest primitive of a packed leaf (-1 if none hit)
+// On a hit, hit is set to that primitive's distance and surface coordinates
+template <typename Pack>
+static int intersectLeafPacks(const Pack* packs, const BVHNode& node,
+                              const std::vector<PrimRef>& prims,
+                              const RayT<Real>& ray, Hit& hit) {
+  int nearest = -1;
+  double nearestT = std::numeric_limits<double>::max();
+  double nearestU = 0.0, nearestV = 0.0;
+  const int count = packCount(node.shapeCount);
+  for (int p = 0; p < count; ++p) {
+    double t, u, v;
+    const int lane = packs[p].intersect(ray, t, u, v);
+    if (lane >= 0 && t < nearestT) {
+      nearestT = t;
+      nearestU = u;
+      nearestV = v;
+      nearest = node.shapeIndex + p * Pack::WIDTH + lane;
+    }
+  }
+  if (nearest >= 0) hit = Hit{nearestT, prims[nearest], nearestU, nearestV};
+  return nearest;
+}
 
 // Clear bin data
 void BVH::Bin::clear() {
@@ -28,17 +87,15 @@ void BVH::Bin::add(const Bounds& b) {
 }
 
 // Recursively build BVH and return index of this node
-int BVH::buildRecursive(
-    const std::vector<std::unique_ptr<BoundedShape>>& shapes, int start,
-    int end) {
+int BVH::buildRecursive(int start, int end) {
   // Compute bounds for this node
   const int n = end - start;
-  Bounds nodeBounds = shapes[shapeIndices[start]]->bounds;
-  Bounds centroidBounds = Bounds(shapes[shapeIndices[start]]->bounds.center);
+  Bounds nodeBounds = primBounds[primIndices[start]];
+  Bounds centroidBounds = Bounds(primBounds[primIndices[start]].center);
 
   // Already handled first shape
   for (int i = start + 1; i < end; i++) {
-    const Bounds& b = shapes[shapeIndices[i]]->bounds;
+    const Bounds& b = primBounds[primIndices[i]];
     nodeBounds.expand(b);
     centroidBounds.expand(b.center);
   }
@@ -49,8 +106,10 @@ int BVH::buildRecursive(
   BVHNode& node = nodes.back();
 
   // If number of shapes is below threshold, make leaf node
-  if (n <= LEAF_THRESHOLD) {
-    node.bounds = nodeBounds;
+  // Packs are tested a whole pack at a time, so packed leaves may hold more
+  if (n <= LEAF_THRESHOLD || (n <= PACKED_LEAF_THRESHOLD &&
+                              leafPackType(start, end) != PackType::NONE)) {
+    node.bounds = toNodeBounds(nodeBounds);
     node.shapeIndex = start;
     node.shapeCount = n;
     return nodeIndex;
@@ -62,33 +121,33 @@ int BVH::buildRecursive(
   if (extent.y() > extent.x()) axis = 1;
   if (extent.z() > extent[axis]) axis = 2;
 
-  auto [splitIndex, splitPos] = getBestSAHSplit(shapes, start, end, axis);
+  auto [splitIndex, splitPos] = getBestSAHSplit(start, end, axis);
 
   if (splitIndex <= start || splitIndex >= end) {
     // SAH failed to find a good split, do median split
     splitIndex = start + n / 2;
     // Sort shape indices by centroid along chosen axis
-    std::nth_element(shapeIndices.begin() + start,
-                     shapeIndices.begin() + splitIndex,
-                     shapeIndices.begin() + end, [&](int a, int b) {
-                       return shapes[a]->bounds.center[axis] <
-                              shapes[b]->bounds.center[axis];
+    std::nth_element(primIndices.begin() + start,
+                     primIndices.begin() + splitIndex,
+                     primIndices.begin() + end, [&](int a, int b) {
+                       return primBounds[a].center[axis] <
+                              primBounds[b].center[axis];
                      });
   } else {
     // Partition shapes around split position found by SAH
-    auto [splitIndex, splitPos_] = getBestSAHSplit(shapes, start, end, axis);
+    auto [splitIndex, splitPos_] = getBestSAHSplit(start, end, axis);
     auto splitPos = splitPos_;
     auto midIter =
-        std::partition(shapeIndices.begin() + start, shapeIndices.begin() + end,
+        std::partition(primIndices.begin() + start, primIndices.begin() + end,
                        [&](int index) {
-                         return shapes[index]->bounds.center[axis] < splitPos;
+                         return primBounds[index].center[axis] < splitPos;
                        });
-    splitIndex = midIter - shapeIndices.begin();
+    splitIndex = midIter - primIndices.begin();
   }
 
   // Recursively build child nodes
-  int leftChild = buildRecursive(shapes, start, splitIndex);
-  int rightChild = buildRecursive(shapes, splitIndex, end);
+  int leftChild = buildRecursive(start, splitIndex);
+  int rightChild = buildRecursive(splitIndex, end);
 
   // Swap children if needed to improve traversal performance (left first)
   if (nodes[leftChild].bounds.area > nodes[rightChild].bounds.area) {
@@ -96,26 +155,38 @@ int BVH::buildRecursive(
   }
 
   // Update current node
-  node.bounds = nodeBounds;
+  node.bounds = toNodeBounds(nodeBounds);
   node.left = leftChild;
   node.right = rightChild;
   return nodeIndex;
 }
 
+// World-space bounds converted to a node's origin-relative bounds
+BoundsT<Real> BVH::toNodeBounds(const Bounds& b) const {
+  return BoundsT<Real>(Bounds(b.min - origin, b.max - origin));
+}
+
+// Pack every primitive in [start, end) of primIndices fits (NONE if mixed)
+PackType BVH::leafPackType(int start, int end) const {
+  const PackType type = primPacks[primIndices[start]];
+  for (int i = start + 1; i < end; ++i) {
+    if (primPacks[primIndices[i]] != type) return PackType::NONE;
+  }
+  return type;
+}
+
 // Find best split using Surface Area Heuristic (SAH)
 // Returns pair of (split index, split position)
-std::pair<int, double> BVH::getBestSAHSplit(
-    const std::vector<std::unique_ptr<BoundedShape>>& shapes, int start,
-    int end, int axis) {
+std::pair<int, double> BVH::getBestSAHSplit(int start, int end, int axis) {
   const int n = end - start;
   if (n <= 2) return std::make_pair(start, 0.0);  // No split possible
 
   // Compute node and centroid bounds
-  Bounds parentBounds = shapes[shapeIndices[start]]->bounds;
-  double centerMin = shapes[shapeIndices[start]]->bounds.center[axis];
+  Bounds parentBounds = primBounds[primIndices[start]];
+  double centerMin = primBounds[primIndices[start]].center[axis];
   double centerMax = centerMin;
   for (int i = start + 1; i < end; i++) {
-    const Bounds& b = shapes[shapeIndices[i]]->bounds;
+    const Bounds& b = primBounds[primIndices[i]];
     parentBounds.expand(b);
     double c = b.center[axis];
     if (c < centerMin) centerMin = c;
@@ -129,7 +200,7 @@ std::pair<int, double> BVH::getBestSAHSplit(
   std::vector<Bin> bins(BIN_COUNT);
   const double extentInv = 1.0 / (centerMax - centerMin);
   for (int i = start; i < end; ++i) {
-    const Bounds& b = shapes[shapeIndices[i]]->bounds;
+    const Bounds& b = primBounds[primIndices[i]];
     double c = b.center[axis];
     int binIndex =
         std::min(static_cast<int>(BIN_COUNT * (c - centerMin) * extentInv),
@@ -199,7 +270,7 @@ std::pair<int, double> BVH::getBestSAHSplit(
   // Count how many shapes go to the left of the split
   int leftCount = 0;
   for (int i = start; i < end; ++i) {
-    const Bounds& b = shapes[shapeIndices[i]]->bounds;
+    const Bounds& b = primBounds[primIndices[i]];
     if (b.center[axis] < splitPos) {
       leftCount++;
     }
@@ -207,30 +278,559 @@ std::pair<int, double> BVH::getBestSAHSplit(
   return std::make_pair(start + leftCount, splitPos);
 }
 
-void BVH::build(const std::vector<std::unique_ptr<BoundedShape>>& shapes) {
-  // Initialize shape indices
-  shapeIndices.resize(shapes.size());
-  std::iota(shapeIndices.begin(), shapeIndices.end(), 0);
+// Seconds elapsed since start
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void BVH::build(const Scene& scene, BVHBuildMethod method, ThreadPool* pool) {
+  buildTimes.clear();
+  auto start = std::chrono::steady_clock::now();
+
+  // Store geometry relative to the camera, so float traversal keeps its
+  // precision near the viewer however large the world coordinates are
+  origin = scene.getCamera().position;
+
+  // Gather references to and bounds of every bounded primitive
+  size_t setPacks = 0;
+  for (const SphereSet& set : scene.sphereSets) setPacks += set.packCount();
+  std::vector<PrimRef> refs;
+  refs.reserve(scene.boundedShapeCount() + scene.meshTriangleCount() +
+               scene.meshQuadCount() + scene.compressedTriangleCount() +
+               setPacks);
+  primBounds.clear();
+  primBounds.reserve(refs.capacity());
+  auto gather = [&](const auto& shapes, uint32_t type) {
+    for (size_t i = 0; i < shapes.size(); ++i) {
+      refs.push_back(PrimRef{type, static_cast<uint32_t>(i), 0});
+      primBounds.push_back(shapes[i].bounds());
+    }
+  };
+  gather(scene.spheres, PrimRef::SPHERE);
+  gather(scene.triangles, PrimRef::TRIANGLE);
+  gather(scene.cylinders, PrimRef::CYLINDER);
+  gather(scene.fields, PrimRef::DISTANCE_FIELD);
+  for (size_t i = 0; i < scene.instances.size(); ++i) {
+    refs.push_back(PrimRef{PrimRef::INSTANCE, static_cast<uint32_t>(i), 0});
+    primBounds.push_back(scene.instances[i].bounds());
+  }
+  for (size_t m = 0; m < scene.meshes.size(); ++m) {
+    const TriangleMesh& mesh = scene.meshes[m];
+    for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+      refs.push_back(PrimRef{PrimRef::MESH_TRIANGLE, static_cast<uint32_t>(m),
+                             static_cast<uint32_t>(t)});
+      primBounds.push_back(mesh.triangleBounds(t));
+    }
+  }
+  for (size_t m = 0; m < scene.quadMeshes.size(); ++m) {
+    const QuadMesh& mesh = scene.quadMeshes[m];
+    for (size_t q = 0; q < mesh.quadCount(); ++q) {
+      refs.push_back(PrimRef{PrimRef::MESH_QUAD, static_cast<uint32_t>(m),
+                             static_cast<uint32_t>(q)});
+      primBounds.push_back(mesh.quadBounds(q));
+    }
+  }
+  for (size_t m = 0; m < scene.compressedMeshes.size(); ++m) {
+    const CompressedMesh& mesh = scene.compressedMeshes[m];
+    for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+      refs.push_back(PrimRef{PrimRef::COMPRESSED_TRIANGLE,
+                             static_cast<uint32_t>(m),
+                             static_cast<uint32_t>(t)});
+      primBounds.push_back(mesh.triangleBounds(t));
+    }
+  }
+  for (size_t s = 0; s < scene.sphereSets.size(); ++s) {
+    const SphereSet& set = scene.sphereSets[s];
+    for (size_t p = 0; p < set.packCount(); ++p) {
+      refs.push_back(PrimRef{PrimRef::SET_SPHERE, static_cast<uint32_t>(s),
+                             static_cast<uint32_t>(p)});
+      primBounds.push_back(set.packBounds(p));
+    }
+  }
+  const int n = static_cast<int>(refs.size());
+
+  // Mark primitives that can share a packed leaf
+  primPacks.resize(n);
+  for (int i = 0; i < n; ++i) primPacks[i] = packTypeOf(refs[i]);
+
+  // Initialize primitive indices
+  primIndices.resize(n);
+  std::iota(primIndices.begin(), primIndices.end(), 0);
 
   // Clear and reserve nodes
   nodes.clear();
-  nodes.reserve(shapes.size() * 2);
+  nodes.reserve(n * 2);
+  prims.clear();
+  packs.clear();
+  spherePacks.clear();
+  buildTimes.emplace_back("setup", secondsSince(start));
+
+  if (n == 0) return;
+
+  if (method == BVHBuildMethod::PLOC) {
+    // Bottom-up build, using a temporary pool if none was provided
+    if (pool) {
+      buildPLOC(*pool);
+    } else {
+      ThreadPool localPool{std::thread::hardware_concurrency()};
+      buildPLOC(localPool);
+    }
+  } else {
+    // Build BVH recursively
+    start = std::chrono::steady_clock::now();
+    buildRecursive(0, n);
+    buildTimes.emplace_back("binned_sah", secondsSince(start));
+  }
+
+  // Store primitives in leaf order and free build-only data
+  prims.resize(n);
+  for (int i = 0; i < n; ++i) prims[i] = refs[primIndices[i]];
+  std::vector<int>().swap(primIndices);
+  std::vector<Bounds>().swap(primBounds);
+  std::vector<PackType>().swap(primPacks);
+
+  // Group each leaf's primitives by type so dispatch branches predictably,
+  // then pack the primitives of all-triangle and all-sphere leaves
+  start = std::chrono::steady_clock::now();
+  for (const BVHNode& node : nodes) {
+    if (node.shapeCount == 0) continue;
+    std::stable_sort(prims.begin() + node.shapeIndex,
+                     prims.begin() + node.shapeIndex + node.shapeCount,
+                     [](const PrimRef& a, const PrimRef& b) {
+                       return a.type < b.type;
+                     });
+  }
+  buildPacks(scene);
+  buildTimes.emplace_back("leaves", secondsSince(start));
 
-  if (shapes.empty()) return;
+  // Reorder nodes for cache-friendly traversal
+  start = std::chrono::steady_clock::now();
+  relayout();
+  buildTimes.emplace_back("relayout", secondsSince(start));
+}
+
+// Copy primitives of every leaf holding only triangles or only spheres into
+// packs of that type
+void BVH::buildPacks(const Scene& scene) {
+  for (BVHNode& node : nodes) {
+    if (node.shapeCount == 0) continue;
+    const PrimRef* first = &prims[node.shapeIndex];
+    const PackType type = packTypeOf(first[0]);
+    if (type == PackType::NONE ||
+        !std::all_of(first, first + node.shapeCount, [&](const PrimRef& p) {
+          return packTypeOf(p) == type;
+        })) {
+      continue;
+    }
+
+    node.packType = type;
+    if (type == PackType::SPHERES) {
+      node.packIndex = static_cast<int>(spherePacks.size());
+      spherePacks.resize(spherePacks.size() + packCount(node.shapeCount));
+      for (int i = 0; i < node.shapeCount; ++i) {
+        SpherePack& pack = spherePacks[node.packIndex + i / SpherePack::WIDTH];
+        const int lane = i % SpherePack::WIDTH;
+        const Sphere& sphere = scene.spheres[first[i].object];
+        pack.set(lane, sphere.center - origin, sphere.radius);
+      }
+      continue;
+    }
 
-  // Build BVH recursively
-  buildRecursive(shapes, 0, shapes.size());
+    node.packIndex = static_cast<int>(packs.size());
+    packs.resize(packs.size() + packCount(node.shapeCount));
+    for (int i = 0; i < node.shapeCount; ++i) {
+      TrianglePack& pack = packs[node.packIndex + i / TrianglePack::WIDTH];
+      const int lane = i % TrianglePack::WIDTH;
+      const PrimRef& prim = first[i];
+      if (prim.type == PrimRef::MESH_TRIANGLE) {
+        const TriangleMesh& mesh = scene.meshes[prim.object];
+        const Vector& a = mesh.positions[mesh.indices[3 * prim.element]];
+        const Vector& b = mesh.positions[mesh.indices[3 * prim.element + 1]];
+        const Vector& c = mesh.positions[mesh.indices[3 * prim.element + 2]];
+        pack.set(lane, a - origin, b - a, c - a);
+      } else {
+        const Triangle& tri = scene.triangles[prim.object];
+        pack.set(lane, tri.v0 - origin, tri.e1, tri.e2);
+      }
+    }
+  }
+}
+
+// Reorder nodes into van Emde Boas order and remap child indices
+// The layout is cache-oblivious: every subtree of every height is stored
+// contiguously, so a ray descending the tree touches few cache lines and
+// pages at every level of the memory hierarchy. The root stays at index 0.
+void BVH::relayout() {
+  if (nodes.size() <= 1) return;
+
+  // Builders emit parents before children, so heights fill in reverse
+  std::vector<int> heights(nodes.size(), 1);
+  for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i) {
+    const BVHNode& node = nodes[i];
+    if (node.shapeCount > 0) continue;
+    heights[i] = 1 + std::max(heights[node.left], heights[node.right]);
+  }
+
+  std::vector<int> order;
+  order.reserve(nodes.size());
+  layoutVEB(0, heights[0], order);
+
+  // Move nodes to their new positions
+  std::vector<int> newIndex(nodes.size());
+  for (size_t i = 0; i < order.size(); ++i) newIndex[order[i]] = i;
+  std::vector<BVHNode> reordered;
+  reordered.reserve(nodes.size());
+  for (const int old : order) {
+    BVHNode node = nodes[old];
+    if (node.left >= 0) node.left = newIndex[node.left];
+    if (node.right >= 0) node.right = newIndex[node.right];
+    reordered.push_back(node);
+  }
+  nodes.swap(reordered);
 }
 
-// Traverse BVH with ray and invoke callback on hits
-void BVH::traverse(const std::vector<std::unique_ptr<BoundedShape>>& shapes,
-                   const Ray& ray,
-                   const std::function<void(const HitInfo&)>& callback) const {
-  if (nodes.empty()) return;
+// Append the nodes of the top height levels below root in vEB order
+// The top half of the levels is laid out first, followed by each subtree
+// hanging below it, each laid out recursively the same way
+void BVH::layoutVEB(int root, int height, std::vector<int>& order) const {
+  if (height == 1 || nodes[root].shapeCount > 0) {
+    order.push_back(root);
+    return;
+  }
+
+  const int topHeight = height / 2;
+  layoutVEB(root, topHeight, order);
+
+  std::vector<int> bottoms;
+  collectAtDepth(root, topHeight, bottoms);
+  for (const int bottom : bottoms) {
+    layoutVEB(bottom, height - topHeight, order);
+  }
+}
+
+// Collect nodes exactly depth levels below root (left to right)
+void BVH::collectAtDepth(int root, int depth, std::vector<int>& out) const {
+  if (depth == 0) {
+    out.push_back(root);
+    return;
+  }
+  const BVHNode& node = nodes[root];
+  if (node.shapeCount > 0) return;
+  collectAtDepth(node.left, depth - 1, out);
+  collectAtDepth(node.right, depth - 1, out);
+}
+
+// Split [0, n) into one chunk per worker, run body on each and wait
+static void parallelFor(ThreadPool& pool, int n,
+                        const std::function<void(int, int)>& body) {
+  const int chunks = std::max(1, std::min(pool.size(), n));
+  const int chunkSize = (n + chunks - 1) / chunks;
+  for (int begin = 0; begin < n; begin += chunkSize) {
+    const int end = std::min(n, begin + chunkSize);
+    pool.enqueue([&body, begin, end]() { body(begin, end); });
+  }
+  pool.wait();
+}
+
+// Surface area of the box enclosing both bounds
+static double unionArea(const Bounds& a, const Bounds& b) {
+  const Vector diff = a.max.max(b.max) - a.min.min(b.min);
+  return 2.0 *
+         (diff.x() * diff.y() + diff.y() * diff.z() + diff.z() * diff.x());
+}
+
+// Build BVH bottom-up with parallel locally-ordered clustering (PLOC)
+// Primitives are sorted along a Morton curve, then each pass pairs every
+// cluster with the neighbor (within PLOC_RADIUS) whose merged box is smallest
+// and merges all mutually nearest pairs until a single root remains
+void BVH::buildPLOC(ThreadPool& pool) {
+  const int n = static_cast<int>(primBounds.size());
+
+  // Compute Morton codes of primitive centroids
+  auto start = std::chrono::steady_clock::now();
+  Bounds centroidBounds(primBounds[0].center);
+  for (int i = 1; i < n; ++i) centroidBounds.expand(primBounds[i].center);
+  const Vector extent = centroidBounds.max - centroidBounds.min;
+  const Vector invExtent(extent.x() > 0.0 ? 1.0 / extent.x() : 0.0,
+                         extent.y() > 0.0 ? 1.0 / extent.y() : 0.0,
+                         extent.z() > 0.0 ? 1.0 / extent.z() : 0.0);
+
+  std::vector<uint64_t> codes(n);
+  parallelFor(pool, n, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const Vector rel = primBounds[i].center - centroidBounds.min;
+      codes[i] = mortonCode(Vector(rel.x() * invExtent.x(),
+                                   rel.y() * invExtent.y(),
+                                   rel.z() * invExtent.z()));
+    }
+  });
+  buildTimes.emplace_back("morton", secondsSince(start));
+
+  // Sort primitives along the Morton curve
+  start = std::chrono::steady_clock::now();
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return codes[a] < codes[b] || (codes[a] == codes[b] && a < b);
+  });
+  buildTimes.emplace_back("sort", secondsSince(start));
+
+  // One single-primitive cluster per primitive, in Morton order
+  start = std::chrono::steady_clock::now();
+  std::vector<Cluster> clusters;
+  clusters.reserve(2 * n - 1);
+  std::vector<int> active(n);
+  for (int i = 0; i < n; ++i) {
+    clusters.emplace_back(primBounds[order[i]], order[i]);
+    active[i] = i;
+  }
+
+  std::vector<int> neighbors;
+  std::vector<int> next;
+  while (active.size() > 1) {
+    const int count = static_cast<int>(active.size());
+
+    // Find nearest neighbor of every active cluster within the search window
+    neighbors.assign(count, -1);
+    parallelFor(pool, count, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        const Bounds& b = clusters[active[i]].bounds;
+        double bestArea = std::numeric_limits<double>::max();
+        const int lo = std::max(0, i - PLOC_RADIUS);
+        const int hi = std::min(count - 1, i + PLOC_RADIUS);
+        for (int j = lo; j <= hi; ++j) {
+          if (j == i) continue;
+          const double area = unionArea(b, clusters[active[j]].bounds);
+          if (area < bestArea) {
+            bestArea = area;
+            neighbors[i] = j;
+          }
+        }
+      }
+    });
+
+    // Merge mutual nearest neighbors, keeping merged cluster in first slot
+    next.clear();
+    for (int i = 0; i < count; ++i) {
+      const int j = neighbors[i];
+      if (neighbors[j] != i) {
+        next.push_back(active[i]);
+      } else if (i < j) {
+        const Cluster& a = clusters[active[i]];
+        const Cluster& b = clusters[active[j]];
+        Bounds merged = a.bounds;
+        merged.expand(b.bounds);
+        clusters.emplace_back(merged, active[i], active[j], a.count + b.count);
+        next.push_back(static_cast<int>(clusters.size()) - 1);
+      }
+    }
+
+    // Ties can leave no mutual pair; force progress by merging the first two
+    if (static_cast<int>(next.size()) == count) {
+      const Cluster& a = clusters[active[0]];
+      const Cluster& b = clusters[active[1]];
+      Bounds merged = a.bounds;
+      merged.expand(b.bounds);
+      clusters.emplace_back(merged, active[0], active[1], a.count + b.count);
+      next.erase(next.begin());
+      next[0] = static_cast<int>(clusters.size()) - 1;
+    }
+    active.swap(next);
+  }
+  buildTimes.emplace_back("cluster", secondsSince(start));
+
+  // Collapse small subtrees into leaves where SAH says a leaf is cheaper
+  // Children are always created before parents, so one forward pass suffices
+  start = std::chrono::steady_clock::now();
+  std::vector<double> costs(clusters.size());
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    Cluster& cluster = clusters[i];
+    if (cluster.prim >= 0) {
+      cluster.pack = primPacks[cluster.prim];
+    } else if (clusters[cluster.left].pack == clusters[cluster.right].pack) {
+      cluster.pack = clusters[cluster.left].pack;
+    }
+    const double leafCost =
+        (cluster.pack != PackType::NONE
+             ? PACK_INTERSECTION_COST * packCount(cluster.count)
+             : INTERSECTION_COST * cluster.count) *
+        cluster.bounds.area;
+    if (cluster.prim >= 0) {
+      costs[i] = leafCost;
+      continue;
+    }
+    const double splitCost = TRAVERSAL_COST * cluster.bounds.area +
+                             costs[cluster.left] + costs[cluster.right];
+    const int maxLeafSize =
+        cluster.pack != PackType::NONE ? PACKED_LEAF_THRESHOLD
+                                       : LEAF_THRESHOLD;
+    cluster.leaf = cluster.count <= maxLeafSize && leafCost <= splitCost;
+    costs[i] = cluster.leaf ? leafCost : splitCost;
+  }
+
+  // Flatten cluster tree into the node array, root first
+  int nextPrim = 0;
+  emitCluster(clusters, active[0], nextPrim);
+  buildTimes.emplace_back("emit", secondsSince(start));
+}
+
+// Append node for cluster (and its subtree) and return its index
+int BVH::emitCluster(const std::vector<Cluster>& clusters, int index,
+                     int& nextPrim) {
+  const Cluster& cluster = clusters[index];
+  const int nodeIndex = nodes.size();
+  nodes.emplace_back(toNodeBounds(cluster.bounds));
+
+  if (cluster.prim >= 0 || cluster.leaf) {
+    nodes[nodeIndex].shapeIndex = nextPrim;
+    nodes[nodeIndex].shapeCount = cluster.count;
+    collectPrims(clusters, index, nextPrim);
+    return nodeIndex;
+  }
+
+  int leftChild = emitCluster(clusters, cluster.left, nextPrim);
+  int rightChild = emitCluster(clusters, cluster.right, nextPrim);
+
+  // Swap children if needed to improve traversal performance (left first)
+  if (nodes[leftChild].bounds.area > nodes[rightChild].bounds.area) {
+    std::swap(leftChild, rightChild);
+  }
+  nodes[nodeIndex].left = leftChild;
+  nodes[nodeIndex].right = rightChild;
+  return nodeIndex;
+}
+
+// Write indices of all primitives under cluster into primIndices
+void BVH::collectPrims(const std::vector<Cluster>& clusters, int index,
+                       int& nextPrim) {
+  const Cluster& cluster = clusters[index];
+  if (cluster.prim >= 0) {
+    primIndices[nextPrim++] = cluster.prim;
+    return;
+  }
+  collectPrims(clusters, cluster.left, nextPrim);
+  collectPrims(clusters, cluster.right, nextPrim);
+}
+
+// Walk the tree and collect structural statistics
+BVHStats BVH::getStats() const {
+  BVHStats stats;
+  stats.nodeCount = static_cast<int>(nodes.size());
+  stats.memoryBytes = nodes.size() * sizeof(BVHNode) +
+                      prims.size() * sizeof(PrimRef) +
+                      packs.size() * sizeof(TrianglePack) +
+                      spherePacks.size() * sizeof(SpherePack);
+  stats.buildTimes = buildTimes;
+  if (nodes.empty()) return stats;
+
+  const double rootArea = nodes[0].bounds.area;
+  const double invRootArea = rootArea > 0.0 ? 1.0 / rootArea : 0.0;
+  long long depthSum = 0;
 
   struct StackItem {
     int nodeIndex;
-    double tmin;
+    int depth;
+  };
+  std::vector<StackItem> stack;
+  stack.push_back(StackItem{0, 0});
+
+  while (!stack.empty()) {
+    StackItem item = stack.back();
+    stack.pop_back();
+    const BVHNode& node = nodes[item.nodeIndex];
+    const double relArea = node.bounds.area * invRootArea;
+
+    if (node.shapeCount > 0) {
+      // Leaf node: cost of testing every shape it holds
+      stats.leafCount++;
+      stats.maxDepth = std::max(stats.maxDepth, item.depth);
+      depthSum += item.depth;
+      if (static_cast<int>(stats.leafSizeHistogram.size()) <=
+          node.shapeCount) {
+        stats.leafSizeHistogram.resize(node.shapeCount + 1, 0);
+      }
+      stats.leafSizeHistogram[node.shapeCount]++;
+      const double leafCost =
+          node.packType != PackType::NONE
+              ? PACK_INTERSECTION_COST * packCount(node.shapeCount)
+              : INTERSECTION_COST * node.shapeCount;
+      stats.sahCost += leafCost * relArea;
+      continue;
+    }
+
+    // Internal node: cost of visiting it plus overlap of its children
+    stats.sahCost += TRAVERSAL_COST * relArea;
+    if (node.left >= 0 && node.right >= 0) {
+      const BoundsT<Real>& a = nodes[node.left].bounds;
+      const BoundsT<Real>& b = nodes[node.right].bounds;
+      const VectorT<Real> lo = a.min.max(b.min);
+      const VectorT<Real> hi = a.max.min(b.max);
+      if (lo.x() < hi.x() && lo.y() < hi.y() && lo.z() < hi.z()) {
+        stats.siblingOverlap += BoundsT<Real>(lo, hi).area * invRootArea;
+      }
+    }
+    if (node.left >= 0) stack.push_back(StackItem{node.left, item.depth + 1});
+    if (node.right >= 0) {
+      stack.push_back(StackItem{node.right, item.depth + 1});
+    }
+  }
+
+  if (stats.leafCount > 0) {
+    stats.avgLeafDepth = static_cast<double>(depthSum) / stats.leafCount;
+  }
+  return stats;
+}
+
+// Write statistics as a single JSON object
+void BVHStats::writeJSON(std::ostream& os) const {
+  os << "{\n";
+  os << "  \"nodeCount\": " << nodeCount << ",\n";
+  os << "  \"leafCount\": " << leafCount << ",\n";
+  os << "  \"maxDepth\": " << maxDepth << ",\n";
+  os << "  \"avgLeafDepth\": " << avgLeafDepth << ",\n";
+  os << "  \"leafSizeHistogram\": [";
+  for (size_t i = 0; i < leafSizeHistogram.size(); ++i) {
+    os << (i > 0 ? ", " : "") << leafSizeHistogram[i];
+  }
+  os << "],\n";
+  os << "  \"sahCost\": " << sahCost << ",\n";
+  os << "  \"siblingOverlap\": " << siblingOverlap << ",\n";
+  os << "  \"memoryBytes\": " << memoryBytes << ",\n";
+  os << "  \"buildTimes\": {";
+  for (size_t i = 0; i < buildTimes.size(); ++i) {
+    os << (i > 0 ? ", " : "") << "\"" << buildTimes[i].first
+       << "\": " << buildTimes[i].second;
+  }
+  os << "}\n";
+  os << "}\n";
+}
+
+// Packs hold copies of their geometry, so only prims needs renumbering
+void BVH::reorderScene(Scene& scene) { scene.reorderPrimitives(prims); }
+
+// Index in prims of the nearest primitive of a packed leaf (-1 if none hit)
+int BVH::intersectPacks(const BVHNode& node, const RayT<Real>& ray,
+                        Hit& hit) const {
+  if (node.packType == PackType::SPHERES) {
+    return intersectLeafPacks(&spherePacks[node.packIndex], node, prims, ray,
+                              hit);
+  }
+  return intersectLeafPacks(&packs[node.packIndex], node, prims, ray, hit);
+}
+
+// Find the closest hit along ray, nearer than closest.t
+// Returns true and updates closest if one was found. Nodes entirely behind
+// the closest hit so far are skipped.
+bool BVH::traverse(const Scene& scene, const Ray& ray, Hit& closest) const {
+  if (nodes.empty()) return false;
+  const RayT<Real> nodeRay(VectorT<Real>(ray.orig - origin),
+                          VectorT<Real>(ray.dir));
+
+  struct StackItem {
+    int nodeIndex;
+    Real tmin;
   };
 
   // Construct stack for traversal
@@ -238,24 +838,32 @@ void BVH::traverse(const std::vector<std::unique_ptr<BoundedShape>>& shapes,
   std::vector<StackItem> stack;
   stack.emplace_back(StackItem{0, 0.0f});
 
+  bool found = false;
   while (!stack.empty()) {
     StackItem item = stack.back();
     stack.pop_back();
 
     const BVHNode& node = nodes[item.nodeIndex];
 
-    // Check if ray intersects node bounds
-    double tmin, tmax;
-    if (!node.bounds.intersects(ray, tmin, tmax)) continue;
-    if (tmax < item.tmin) continue;
-
-    if (node.shapeCount > 0) {
-      // Leaf node: test all shapes in this node
+    // Check if ray intersects node bounds before the closest hit
+    Real tmin, tmax;
+    if (!node.bounds.intersects(nodeRay, tmin, tmax)) continue;
+    if (tmax < item.tmin || tmin > closest.t) continue;
+
+    Hit hit;
+    if (node.packType != PackType::NONE) {
+      // Packed leaf: nearest primitive of all packs at once
+      if (intersectPacks(node, nodeRay, hit) >= 0 && hit.t < closest.t) {
+        closest = hit;
+        found = true;
+      }
+    } else if (node.shapeCount > 0) {
+      // Leaf node: test all primitives in this node
       for (int i = 0; i < node.shapeCount; ++i) {
-        std::optional<HitInfo> hitOpt =
-            shapes[shapeIndices[node.shapeIndex + i]]->intersects(ray);
-        if (hitOpt.has_value()) {
-          callback(hitOpt.value());
+        if (scene.intersect(prims[node.shapeIndex + i], ray, hit) &&
+            hit.t < closest.t) {
+          closest = hit;
+          found = true;
         }
       }
     } else {
@@ -264,16 +872,22 @@ void BVH::traverse(const std::vector<std::unique_ptr<BoundedShape>>& shapes,
       if (node.left >= 0) stack.emplace_back(StackItem{node.left, tmin});
     }
   }
+  return found;
 }
 
-void BVH::traverseFirstHit(
-    const std::vector<std::unique_ptr<BoundedShape>>& shapes, const Ray& ray,
-    const std::function<void(const HitInfo&)>& callback) const {
-  if (nodes.empty()) return;
+// Traverse BVH and stop at the first hit between EPS and tMax along ray,
+// which is stored in hit. Hits outside that range don't end the search.
+// Returns the primitive that was hit (nullptr if nothing was hit)
+const PrimRef* BVH::traverseFirstHit(const Scene& scene, const Ray& ray,
+                                     double tMax, Hit& hit) const {
+  if (nodes.empty()) return nullptr;
+  const RayT<Real> nodeRay(VectorT<Real>(ray.orig - origin),
+                          VectorT<Real>(ray.dir));
+  auto inRange = [tMax](double t) { return t > Vector::EPS && t < tMax; };
 
   struct StackItem {
     int nodeIndex;
-    double tmin;
+    Real tmin;
   };
 
   // Construct stack for traversal
@@ -287,19 +901,22 @@ void BVH::traverseFirstHit(
 
     const BVHNode& node = nodes[item.nodeIndex];
 
-    // Check if ray intersects node bounds
-    double tmin, tmax;
-    if (!node.bounds.intersects(ray, tmin, tmax)) continue;
-    if (tmax < item.tmin) continue;
-
-    if (node.shapeCount > 0) {
-      // Leaf node: test all shapes in this node
+    // Check if ray intersects node bounds before tMax
+    Real tmin, tmax;
+    if (!node.bounds.intersects(nodeRay, tmin, tmax)) continue;
+    if (tmax < item.tmin || tmin > tMax) continue;
+
+    if (node.packType != PackType::NONE) {
+      // Packed leaf: packs skip hits before EPS, so if the nearest hit is
+      // past tMax, every other one in the leaf is too
+      const int nearest = intersectPacks(node, nodeRay, hit);
+      if (nearest >= 0 && inRange(hit.t)) return &prims[nearest];
+    } else if (node.shapeCount > 0) {
+      // Leaf node: test all primitives in this node
       for (int i = 0; i < node.shapeCount; ++i) {
-        std::optional<HitInfo> hitOpt =
-            shapes[shapeIndices[node.shapeIndex + i]]->intersects(ray);
-        if (hitOpt.has_value()) {
-          callback(hitOpt.value());
-          return;  // Stop after first hit
+        const PrimRef& prim = prims[node.shapeIndex + i];
+        if (scene.intersect(prim, ray, hit) && inRange(hit.t)) {
+          return &prim;  // Stop after first hit
         }
       }
     } else {
@@ -308,4 +925,5 @@ void BVH::traverseFirstHit(
       if (node.right >= 0) stack.emplace_back(StackItem{node.right, tmin});
     }
   }
-}
\ No newline at end of file
+  return nullptr;
+}
@@ -1,44 +1,123 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
-#include <functional>
+#include <iostream>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "math/real.hpp"
 #include "scene/scene.hpp"
 #include "shapes/shape.hpp"
+#include "shapes/sphere.hpp"
+#include "shapes/triangle.hpp"
 
 // Forward declaration
-class Ray;
+class ThreadPool;
+
+// Kind of SoA pack a leaf's primitives are stored in
+enum class PackType : uint8_t {
+  NONE,       // Primitives are tested one at a time
+  TRIANGLES,  // Leaf holds only triangles, stored in TrianglePacks
+  SPHERES,    // Leaf holds only spheres, stored in SpherePacks
+};
 
 struct BVHNode {
-  Bounds bounds;
+  BoundsT<Real> bounds;
   int left;        // Index of left child in BVH array (-1 if leaf)
   int right;       // Index of right child in BVH array (-1 if leaf)
-  int shapeIndex;  // Index into scene's shape array (-1 if not leaf)
-  int shapeCount;  // Number of objects in this node (0 if not leaf)
+  int shapeIndex;  // Index of first primitive in BVH's prims (-1 if not leaf)
+  int shapeCount;  // Number of primitives in this node (0 if not leaf)
+  int packIndex;   // First pack of leaf (-1 if leaf is not packed)
+  // Pack array packIndex refers to
+  PackType packType;
+
+  BVHNode(const BoundsT<Real>& b)
+      : bounds(b),
+        left(-1),
+        right(-1),
+        shapeIndex(-1),
+        shapeCount(0),
+        packIndex(-1),
+        packType(PackType::NONE) {}
+  BVHNode()
+      : bounds(),
+        left(-1),
+        right(-1),
+        shapeIndex(-1),
+        shapeCount(0),
+        packIndex(-1),
+        packType(PackType::NONE) {}
+};
 
-  BVHNode(const Bounds& b)
-      : bounds(b), left(-1), right(-1), shapeIndex(-1), shapeCount(0) {}
-  BVHNode() : bounds(), left(-1), right(-1), shapeIndex(-1), shapeCount(0) {}
+// Structural quality report of a built BVH
+struct BVHStats {
+  int nodeCount = 0;
+  int leafCount = 0;
+  int maxDepth = 0;                    // Depth of deepest leaf (root is 0)
+  double avgLeafDepth = 0.0;           // Mean depth over leaves
+  std::vector<int> leafSizeHistogram;  // Leaves holding i prims at index i
+  double sahCost = 0.0;                // Total SAH cost relative to root area
+  double siblingOverlap = 0.0;  // Overlap area of sibling boxes / root area
+  size_t memoryBytes = 0;       // Nodes, primitive array and packs
+  std::vector<std::pair<std::string, double>> buildTimes;  // Seconds/phase
+
+  void writeJSON(std::ostream& os) const;
 };
 
 class BVH {
  private:
   std::vector<BVHNode> nodes;
-  std::vector<int> shapeIndices;
+  Vector origin;  // World position node bounds and packs are relative to
+  std::vector<PrimRef> prims;           // Scene primitives in leaf order
+  std::vector<TrianglePack> packs;      // Triangles of all-triangle leaves
+  std::vector<SpherePack> spherePacks;  // Spheres of all-sphere leaves
+  std::vector<int> primIndices;         // Primitive permutation (build only)
+  std::vector<Bounds> primBounds;       // Primitive bounds (build only)
+  std::vector<PackType> primPacks;      // Pack primitive fits (build only)
+  std::vector<std::pair<std::string, double>> buildTimes;
   static constexpr int LEAF_THRESHOLD = 4;
+  static constexpr int PACKED_LEAF_THRESHOLD = 8;
   static constexpr int BIN_COUNT = 32;
   static constexpr double TRAVERSAL_COST = 1.0;
   static constexpr double INTERSECTION_COST = 1.0;
+  static constexpr double PACK_INTERSECTION_COST = 2.0;  // Per whole pack
+  static constexpr int PLOC_RADIUS = 16;  // Neighbor search window (each side)
+
+  // Temporary node of the bottom-up PLOC tree
+  struct Cluster {
+    Bounds bounds;
+    int left = -1;           // Left child cluster (-1 if single primitive)
+    int right = -1;          // Right child cluster (-1 if single primitive)
+    int prim = -1;           // Primitive index (-1 if merged cluster)
+    int count = 1;           // Number of primitives in cluster
+    bool leaf = false;       // Collapse subtree into a single leaf
+    // Pack every primitive in cluster fits (NONE if they differ)
+    PackType pack = PackType::NONE;
+
+    Cluster(const Bounds& b, int p) : bounds(b), prim(p) {}
+    Cluster(const Bounds& b, int l, int r, int n)
+        : bounds(b), left(l), right(r), count(n) {}
+  };
 
-  int buildRecursive(const std::vector<std::unique_ptr<BoundedShape>>& shapes,
-                     int start, int end);
-  std::pair<int, double> getBestSAHSplit(
-      const std::vector<std::unique_ptr<BoundedShape>>& shapes, int start,
-      int end, int axis);
+  int buildRecursive(int start, int end);
+  BoundsT<Real> toNodeBounds(const Bounds& b) const;
+  PackType leafPackType(int start, int end) const;
+  void buildPacks(const Scene& scene);
+  int intersectPacks(const BVHNode& node, const RayT<Real>& ray,
+                     Hit& hit) const;
+  std::pair<int, double> getBestSAHSplit(int start, int end, int axis);
+  void buildPLOC(ThreadPool& pool);
+  int emitCluster(const std::vector<Cluster>& clusters, int index,
+                  int& nextPrim);
+  void collectPrims(const std::vector<Cluster>& clusters, int index,
+                    int& nextPrim);
+  void relayout();
+  void layoutVEB(int root, int height, std::vector<int>& order) const;
+  void collectAtDepth(int root, int depth, std::vector<int>& out) const;
 
   struct Bin {
     Bounds bounds;
@@ -53,19 +132,26 @@ class BVH {
   };
 
  public:
-  BVH(Scene& scene) : nodes(), shapeIndices() { build(scene.bndedShapes); }
+  BVH(const Scene& scene, ThreadPool* pool = nullptr) : nodes(), prims() {
+    build(scene, scene.getBVHBuildMethod(), pool);
+  }
 
   const std::vector<BVHNode>& getNodes() const { return nodes; }
+  const Vector& getOrigin() const { return origin; }
   size_t getNodeCount() const { return nodes.size(); }
-  const std::vector<int>& getShapeIndices() const { return shapeIndices; }
-
-  void build(const std::vector<std::unique_ptr<BoundedShape>>& shapes);
-  void traverse(const std::vector<std::unique_ptr<BoundedShape>>& shapes,
-                const Ray& ray,
-                const std::function<void(const HitInfo&)>& callback) const;
-  void traverseFirstHit(
-      const std::vector<std::unique_ptr<BoundedShape>>& shapes, const Ray& ray,
-      const std::function<void(const HitInfo&)>& callback) const;
+  const std::vector<PrimRef>& getPrims() const { return prims; }
+  BVHStats getStats() const;
+
+  void build(const Scene& scene,
+             BVHBuildMethod method = BVHBuildMethod::BINNED_SAH,
+             ThreadPool* pool = nullptr);
+  // Move scene's primitives into this BVH's leaf order
+  // Other BVHs built over scene no longer match it afterwards
+  void reorderScene(Scene& scene);
+
+  bool traverse(const Scene& scene, const Ray& ray, Hit& closest) const;
+  const PrimRef* traverseFirstHit(const Scene& scene, const Ray& ray,
+                                  double tMax, Hit& hit) const;
 
   ~BVH() = default;
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "instance.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+
+#include "math/ray.hpp"
+#include "math/transform.hpp"
+#include "scene/bvh.hpp"
+#include "scene/prototype.hpp"
+#include "scene/scene.hpp"
+
+static thread_local LodView lodView;
+static thread_local LodHit lodHit;
+static thread_local double lodDither = 0.5;
+
+void setLodView(const LodView& view) { lodView = view; }
+
+const LodView& getLodView() { return lodView; }
+
+void setLodHit(const LodHit& hit) { lodHit = hit; }
+
+const LodHit& getLodHit() { return lodHit; }
+
+void setLodDither(double dither) { lodDither = dither; }
+
+double getLodDither() { return lodDither; }
+
+Instance::Instance(std::shared_ptr<const Prototype> proto,
+                   const Transform& xform, const size_t matOffset)
+    : prototype(std::move(proto)), materialOffset(matOffset) {
+  setTransform(xform);
+}
+
+// Bounds enclose all eight transformed corners of the object bounds
+void Instance::setTransform(const Transform& xform) {
+  transform = xform;
+  scale = transform.scaleFactor();
+
+  const Bounds& local = prototype->getBounds();
+  worldBounds = Bounds();
+  for (int corner = 0; corner < 8; ++corner) {
+    const Vector p((corner & 1) ? local.max.x() : local.min.x(),
+                   (corner & 2) ? local.max.y() : local.min.y(),
+                   (corner & 4) ? local.max.z() : local.min.z());
+    worldBounds.expand(transform.point(p));
+  }
+}
+
+// Footprint of a pixel where the ray enters the bounds, in object space
+// Rays starting inside the bounds measure it at their origin, so the parts of
+// a large model far from the camera get coarse levels even up close
+size_t Instance::selectLevel(const Ray& ray, const Vector& eye,
+                             double spread) const {
+  if (prototype->levelCount() == 1) return 0;
+  double tEntry, tExit;
+  if (!worldBounds.intersects(ray, tEntry, tExit)) tEntry = 0.0;
+  const double footprint = (ray.at(tEntry) - eye).mag() * spread / scale;
+  return prototype->selectLevel(footprint, lodDither);
+}
+
+// Closest hit of the ray, taken into object space, with the prototype
+bool Instance::intersect(const Ray& ray, size_t level, double& t, double& u,
+                         double& v) const {
+  const Prototype::Level& lod = prototype->getLevel(level);
+  Hit hit;
+  if (!lod.bvh.traverse(lod.scene, transform.toObject(ray), hit)) {
+    return false;
+  }
+  t = hit.t;
+  u = static_cast<double>(level);
+  v = 0.0;
+  return true;
+}
+
+// The hit primitive is not recorded by intersect, so the object space ray is
+// traced again through the same level; this only happens once per shaded hit
+HitInfo Instance::hitInfo(const Ray& ray, double t, double u, double) const {
+  const Prototype::Level& lod =
+      prototype->getLevel(static_cast<size_t>(u));
+  const Ray objectRay = transform.toObject(ray);
+  Hit hit;
+  lod.bvh.traverse(lod.scene, objectRay, hit);
+  const HitInfo local = lod.scene.hitInfo(hit, objectRay);
+  return HitInfo(ray.at(t), transform.normal(local.normal).norm(), ray, t,
+                 local.materialIndex + materialOffset);
+}
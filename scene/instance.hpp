@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <memory>
+
+#include "math/ray.hpp"
+#include "math/transform.hpp"
+#include "math/vector.hpp"
+#include "shapes/shape.hpp"
+
+// Forward declaration
+class Prototype;
+
+// Prototype placed in the scene with an affine transform
+// Rays are taken into the prototype's object space and traced through its
+// BVH, so any number of instances share one copy of its geometry.
+class Instance {
+ private:
+  std::shared_ptr<const Prototype> prototype;
+  Transform transform;  // Object to world
+  Bounds worldBounds;
+  double scale;         // Uniform equivalent of the transform's scale
+
+ public:
+  size_t materialOffset;  // Scene index of the prototype's first material
+
+  Instance(std::shared_ptr<const Prototype> proto, const Transform& xform,
+           const size_t matOffset);
+
+  const Transform& getTransform() const { return transform; }
+  void setTransform(const Transform& xform);
+  const Bounds& bounds() const { return worldBounds; }
+
+  // Level of detail of the prototype for ray to trace, for a camera at eye
+  // whose pixels each span the angle spread
+  size_t selectLevel(const Ray& ray, const Vector& eye, double spread) const;
+
+  // On a hit, u is set to the level of detail that was hit
+  bool intersect(const Ray& ray, size_t level, double& t, double& u,
+                 double& v) const;
+  HitInfo hitInfo(const Ray& ray, double t, double u, double v) const;
+};
+
+// Camera position and angle spanned by one pixel, for level of detail selection
+struct LodView {
+  Vector eye;
+  double spread = 0.0;  // 0 always picks the full detail
+};
+
+// View that levels of detail are selected for on this thread
+// The tracer snapshots the camera once per pass and sets it on each thread
+// that traces for the pass, so moving the camera mid-pass doesn't race
+void setLodView(const LodView& view);
+const LodView& getLodView();
+
+// Instance the rays being traced leave from, and the level it was hit at
+// The tracer sets it on each thread for the shadow and reflection rays of a
+// hit, so they meet the surface they start on at the level it was shaded at
+struct LodHit {
+  const Instance* instance = nullptr;  // nullptr when not on an instance
+  size_t level = 0;
+};
+
+void setLodHit(const LodHit& hit);
+const LodHit& getLodHit();
+
+// Dither for stochastic level of detail selection, in [0, 1)
+// The tracer sets it once per pixel sample on each thread, so all rays of
+// one sample fall on the same side of the blend between two levels
+void setLodDither(double dither);
+double getLodDither();
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stddef.h>
+
+#include <functional>
+
 #include "math/color.hpp"
 
 // Stores matieral properties for shapes
@@ -9,4 +13,28 @@ struct Material {
   const double specularFactor = 0.5;
   const double shininess = 8.0;
   const double reflectivity;
-};
\ No newline at end of file
+};
+
+inline bool operator==(const Material& a, const Material& b) {
+  return a.color == b.color && a.specular == b.specular &&
+         a.specularFactor == b.specularFactor && a.shininess == b.shininess &&
+         a.reflectivity == b.reflectivity;
+}
+
+inline bool operator!=(const Material& a, const Material& b) {
+  return !(a == b);
+}
+
+// Hash of every property, so equal materials can share one table entry
+struct MaterialHash {
+  size_t operator()(const Material& m) const {
+    const double values[] = {m.color.r(),      m.color.g(),    m.color.b(),
+                             m.specular.r(),   m.specular.g(), m.specular.b(),
+                             m.specularFactor, m.shininess,    m.reflectivity};
+    size_t hash = 0;
+    for (const double value : values) {
+      hash = hash * 31 + std::hash<double>{}(value);
+    }
+    return hash;
+  }
+};
@@ -0,0 +1,71 @@
+#include "prototype.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "scene/bvh.hpp"
+#include "scene/scene.hpp"
+#include "shapes/mesh.hpp"
+
+// Empty scenes are rejected before the BVH is built
+static const Scene& checkPrototypeScene(const Scene& scene) {
+  if (scene.shapeCount() == scene.planeCount()) {
+    throw std::invalid_argument("Prototype needs at least one bounded shape");
+  }
+  return scene;
+}
+
+// Triangle-weighted mean edge length over all meshes of scene
+double Prototype::meanEdgeLength(const Scene& scene) {
+  const size_t triangles = scene.meshTriangleCount();
+  if (triangles == 0) return 0.0;
+  double sum = 0.0;
+  for (const TriangleMesh& mesh : scene.meshes) {
+    sum += mesh.meanEdgeLength() * mesh.triangleCount();
+  }
+  return sum / triangles;
+}
+
+Prototype::Level::Level(const Scene& s)
+    : scene(s), bvh(scene), edgeLength(meanEdgeLength(scene)) {
+  bvh.reorderScene(scene);
+}
+
+Prototype::Prototype(const Scene& s, int lodLevels)
+    : bounds(checkPrototypeScene(s).bounds()) {
+  if (lodLevels < 0) {
+    throw std::invalid_argument("Level of detail count cannot be negative");
+  }
+  levels.reserve(lodLevels + 1);
+  levels.emplace_back(s);
+
+  // Halve the triangles of every mesh per level, until that stops helping
+  for (int level = 1; level <= lodLevels; ++level) {
+    Scene coarser = levels.back().scene;
+    for (TriangleMesh& mesh : coarser.meshes) {
+      mesh = mesh.simplified(mesh.triangleCount() / 2);
+    }
+    if (coarser.meshTriangleCount() >=
+        levels.back().scene.meshTriangleCount()) {
+      break;
+    }
+    levels.emplace_back(coarser);
+  }
+}
+
+size_t Prototype::selectLevel(double footprint, double dither) const {
+  size_t level = 0;
+  while (level + 1 < levels.size() &&
+         levels[level + 1].edgeLength <= footprint) {
+    level++;
+  }
+  if (level + 1 == levels.size() || footprint <= levels[level].edgeLength) {
+    return level;
+  }
+
+  // Fraction of the way from this level's edges to the next, on a log scale
+  const double lo = levels[level].edgeLength;
+  const double hi = levels[level + 1].edgeLength;
+  const double t = std::log(footprint / lo) / std::log(hi / lo);
+  return dither < t ? level + 1 : level;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "scene/bvh.hpp"
+#include "scene/scene.hpp"
+#include "shapes/shape.hpp"
+
+// Geometry shared by every instance placed from it
+// Holds a copy of a scene and a BVH over its bounded shapes, meshes, sphere
+// sets and instances in object space. The scene's planes, lights and camera
+// are not used. Optionally holds coarser levels of detail, in which each
+// mesh keeps about half the triangles of the level before it.
+class Prototype {
+ public:
+  struct Level {
+    Scene scene;
+    BVH bvh;
+    double edgeLength;  // Mean triangle edge length over meshes (0 if none)
+
+    explicit Level(const Scene& s);
+  };
+
+ private:
+  std::vector<Level> levels;  // Finest first
+  Bounds bounds;
+
+  static double meanEdgeLength(const Scene& scene);
+
+ public:
+  // Throws std::invalid_argument if scene has nothing bounded to instance
+  explicit Prototype(const Scene& s, int lodLevels = 0);
+
+  const Scene& getScene() const { return levels[0].scene; }
+  const BVH& getBVH() const { return levels[0].bvh; }
+  const Bounds& getBounds() const { return bounds; }
+  size_t levelCount() const { return levels.size(); }
+  const Level& getLevel(size_t level) const { return levels[level]; }
+
+  // Level whose triangles best match footprint, the width one pixel covers
+  // at the prototype (in object space). Between two levels the coarser one
+  // is picked with a probability rising across the gap, compared to dither
+  // in [0, 1), so the switch fades in rather than popping.
+  size_t selectLevel(double footprint, double dither) const;
+};
@@ -1,11 +1,24 @@
 #include "scene.hpp"
 
+#include <stdint.h>
+
+#include <cmath>
+#include <memory>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "light.hpp"
+#include "instance.hpp"
 #include "math/color.hpp"
+#include "math/real.hpp"
+#include "math/ray.hpp"
+#include "math/transform.hpp"
 #include "math/vector.hpp"
+#include "prototype.hpp"
 #include "shapes/cylinder.hpp"
+#include "shapes/sdf.hpp"
 #include "shapes/sphere.hpp"
 #include "shapes/triangle.hpp"
 
@@ -30,13 +43,56 @@ void Scene::moveCameraPosition(const Vector& delta) {
 
 void Scene::zoomCamera(double scroll) { camera.zoom(scroll); }
 
+// Current camera as seen by level of detail selection
+LodView Scene::lodView() const {
+  const double spread =
+      height > 0 ? 2.0 * std::tan(camera.fov * M_PI / 360.0) / height : 0.0;
+  return LodView{camera.position, spread};
+}
+
 void Scene::setAmbientLight(const double ambient) { ambientLight = ambient; }
 
+void Scene::setBVHBuildMethod(const BVHBuildMethod method) {
+  bvhMethod = method;
+}
+
+void Scene::setTraceMode(const TraceMode mode) { traceMode = mode; }
+
+// Pixels stop being sampled once the standard error of their mean luminance
+// falls to threshold (0 samples every pixel on every pass)
+void Scene::setNoiseThreshold(const double threshold) {
+  if (threshold < 0) {
+    throw std::invalid_argument("Noise threshold cannot be negative");
+  }
+  noiseThreshold = threshold;
+}
+
+// Side of the square tiles each pass is split into (0 picks one per image)
+void Scene::setTileSize(const int size) {
+  if (size < 0) {
+    throw std::invalid_argument("Tile size cannot be negative");
+  }
+  tileSize = size;
+}
+
+void Scene::setSamplerType(const SamplerType type) { samplerType = type; }
+
+void Scene::setSeed(const uint32_t s) { seed = s; }
+
 // Set background color
 void Scene::setBackground(const int r, const int g, const int b) {
   background = Color(r, g, b);
 }
 
+// Index of material in materials, adding it if no equal one is there yet
+// Shapes sharing a material then share its entry. Prototype materials are
+// appended separately, as one contiguous block per prototype.
+size_t Scene::internMaterial(const Material& m) {
+  auto [entry, isNew] = materialIndices.try_emplace(m, materials.size());
+  if (isNew) materials.push_back(m);
+  return entry->second;
+}
+
 // Add a light to the scene
 void Scene::addLight(const Vector pos, const Color color) {
   lights.push_back(Light{pos, color});
@@ -48,7 +104,7 @@ void Scene::addPlane(const Vector& point, const Vector& normal,
   if (normal.magSq() < Vector::EPS * Vector::EPS) {
     throw std::invalid_argument("Plane normal cannot be zero vector");
   }
-  addPlaneShape(mat, point, normal.norm());
+  addShape(planes, mat, point, normal.norm());
 }
 
 // Add sphere (center, radius) to scene
@@ -57,13 +113,13 @@ void Scene::addSphere(const Vector& center, double radius,
   if (radius < Vector::EPS) {
     throw std::invalid_argument("Sphere radius must be positive");
   }
-  addBoundedShape<Sphere>(mat, center, radius);
+  addShape(spheres, mat, center, radius);
 }
 
 // Add triangle (v0, v1, v2) to scene
 void Scene::addTriangle(const Vector& a, const Vector& b, const Vector& c,
                         const Material& mat) {
-  addBoundedShape<Triangle>(mat, a, b, c);
+  addShape(triangles, mat, a, b, c);
 }
 
 // Add triangle with vertices and normals to scene
@@ -76,10 +132,369 @@ void Scene::addTriangle(const Vector& a, const Vector& b, const Vector& c,
     throw std::invalid_argument(
         "Triangle vertex normals cannot be zero vectors");
   }
-  addBoundedShape<Triangle>(mat, a, b, c, nA.norm(), nB.norm(), nC.norm());
+  addShape(triangles, mat, a, b, c, nA.norm(), nB.norm(), nC.norm());
 }
 
 void Scene::addCylinder(const Vector& c, double r, double h,
                         const Material& m) {
-  addBoundedShape<Cylinder>(m, c, r, h);
+  addShape(cylinders, m, c, r, h);
+}
+
+// Add surface where distance is zero within box (bmin, bmax)
+// distance may change by at most lipschitz per unit moved
+void Scene::addDistanceField(DistanceFunction distance, const Vector& bmin,
+                             const Vector& bmax, double lipschitz,
+                             const Material& mat, int maxSteps,
+                             double tolerance) {
+  if (!distance) {
+    throw std::invalid_argument("Distance field needs a distance function");
+  }
+  if (bmin.x() > bmax.x() || bmin.y() > bmax.y() || bmin.z() > bmax.z()) {
+    throw std::invalid_argument("Distance field box minimum exceeds maximum");
+  }
+  if (lipschitz <= 0.0) {
+    throw std::invalid_argument("Lipschitz bound must be positive");
+  }
+  if (maxSteps <= 0 || tolerance <= 0.0) {
+    throw std::invalid_argument("Step count and tolerance must be positive");
+  }
+  addShape(fields, mat, std::move(distance), bmin, bmax, lipschitz, maxSteps,
+           tolerance);
+}
+
+// Add indexed triangle mesh (three indices into positions per triangle)
+// Normals are either empty (flat shaded) or one per position
+void Scene::addMesh(std::vector<Vector> positions, std::vector<Vector> normals,
+                    std::vector<uint32_t> indices, const Material& mat) {
+  if (indices.size() % 3 != 0) {
+    throw std::invalid_argument("Mesh index count must be a multiple of 3");
+  }
+  if (!normals.empty() && normals.size() != positions.size()) {
+    throw std::invalid_argument("Mesh needs one normal per vertex or none");
+  }
+  for (const uint32_t index : indices) {
+    if (index >= positions.size()) {
+      throw std::invalid_argument("Mesh index out of range");
+    }
+  }
+  for (Vector& normal : normals) normal = normal.norm();
+
+  meshes.emplace_back(std::move(positions), std::move(normals),
+                      std::move(indices), internMaterial(mat));
+}
+
+// Add indexed quad mesh (four indices into positions per quad, in order
+// around its border); normals are either empty or one per position
+void Scene::addQuadMesh(std::vector<Vector> positions,
+                        std::vector<Vector> normals,
+                        std::vector<uint32_t> indices, const Material& mat) {
+  if (indices.size() % 4 != 0) {
+    throw std::invalid_argument(
+        "Quad mesh index count must be a multiple of 4");
+  }
+  if (!normals.empty() && normals.size() != positions.size()) {
+    throw std::invalid_argument("Mesh needs one normal per vertex or none");
+  }
+  for (const uint32_t index : indices) {
+    if (index >= positions.size()) {
+      throw std::invalid_argument("Mesh index out of range");
+    }
+  }
+  for (Vector& normal : normals) normal = normal.norm();
+
+  quadMeshes.emplace_back(std::move(positions), std::move(normals),
+                          std::move(indices), internMaterial(mat));
+}
+
+// Compressed meshes are traced without SoA packs, which would hold a full
+// precision copy of every triangle
+void Scene::compressMeshes() {
+  for (const TriangleMesh& mesh : meshes) compressedMeshes.emplace_back(mesh);
+  std::vector<TriangleMesh>().swap(meshes);
+}
+
+// Add set of spheres (centers[i], radii[i]) sharing one material
+void Scene::addSphereSet(const std::vector<Vector>& centers,
+                         const std::vector<double>& radii,
+                         const Material& mat) {
+  if (centers.size() != radii.size()) {
+    throw std::invalid_argument("Sphere set needs one radius per center");
+  }
+  for (const double radius : radii) {
+    if (radius < Vector::EPS) {
+      throw std::invalid_argument("Sphere radius must be positive");
+    }
+  }
+  sphereSets.emplace_back(centers, radii, internMaterial(mat));
+}
+
+// Place prototype in the scene with transform (object to world)
+// Returns the instance's index, for moving it with setInstanceTransform. The
+// prototype's materials are added once, however many instances share it.
+size_t Scene::addInstance(std::shared_ptr<const Prototype> prototype,
+                          const Transform& transform) {
+  if (!prototype) {
+    throw std::invalid_argument("Instance prototype cannot be null");
+  }
+  auto found = prototypeMaterials.find(prototype.get());
+  if (found == prototypeMaterials.end()) {
+    found = prototypeMaterials.emplace(prototype.get(), materials.size()).first;
+    for (const Material& mat : prototype->getScene().materials) {
+      materials.push_back(mat);
+    }
+  }
+  instances.emplace_back(std::move(prototype), transform, found->second);
+  return instances.size() - 1;
+}
+
+// Move an instance; takes effect when the BVH is next built
+void Scene::setInstanceTransform(size_t instance, const Transform& transform) {
+  if (instance >= instances.size()) {
+    throw std::invalid_argument("Instance index out of range");
+  }
+  instances[instance].setTransform(transform);
+}
+
+// Total number of triangles over all meshes
+size_t Scene::meshTriangleCount() const {
+  size_t count = 0;
+  for (const TriangleMesh& mesh : meshes) count += mesh.triangleCount();
+  return count;
+}
+
+// Total number of quads over all quad meshes
+size_t Scene::meshQuadCount() const {
+  size_t count = 0;
+  for (const QuadMesh& mesh : quadMeshes) count += mesh.quadCount();
+  return count;
+}
+
+// Total number of triangles over all compressed meshes
+size_t Scene::compressedTriangleCount() const {
+  size_t count = 0;
+  for (const CompressedMesh& mesh : compressedMeshes) {
+    count += mesh.triangleCount();
+  }
+  return count;
+}
+
+// Total number of spheres over all sphere sets
+size_t Scene::setSphereCount() const {
+  size_t count = 0;
+  for (const SphereSet& set : sphereSets) count += set.sphereCount();
+  return count;
+}
+
+// Store primitives in the order prims references them, and renumber prims
+// to match. Called with a BVH's leaf order, primitives the same rays visit
+// end up next to each other in memory. Instances keep the indices addInstance
+// returned, and elements of meshes and sphere sets stay in their own mesh or
+// set.
+void Scene::reorderPrimitives(std::vector<PrimRef>& prims) {
+  constexpr uint32_t UNUSED = UINT32_MAX;
+
+  // Old index of each element of each object of type, in the new order
+  auto elementOrder = [&](uint32_t type, size_t objectCount, auto sizeOf) {
+    std::vector<std::vector<uint32_t>> order(objectCount);
+    std::vector<std::vector<uint32_t>> newIndex(objectCount);
+    for (size_t o = 0; o < objectCount; ++o) {
+      newIndex[o].assign(sizeOf(o), UNUSED);
+    }
+    for (PrimRef& prim : prims) {
+      if (prim.type != type) continue;
+      uint32_t& index = newIndex[prim.object][prim.element];
+      if (index == UNUSED) {
+        index = static_cast<uint32_t>(order[prim.object].size());
+        order[prim.object].push_back(prim.element);
+      }
+      prim.element = index;
+    }
+    // Elements the BVH does not reference keep their place at the end
+    for (size_t o = 0; o < objectCount; ++o) {
+      for (uint32_t e = 0; e < newIndex[o].size(); ++e) {
+        if (newIndex[o][e] == UNUSED) order[o].push_back(e);
+      }
+    }
+    return order;
+  };
+
+  // Shapes are copied into a new array, as their members are const
+  auto reorderShapes = [&](auto& shapes, uint32_t type) {
+    std::vector<uint32_t> newIndex(shapes.size(), UNUSED);
+    std::remove_reference_t<decltype(shapes)> sorted;
+    sorted.reserve(shapes.size());
+    for (PrimRef& prim : prims) {
+      if (prim.type != type) continue;
+      if (newIndex[prim.object] == UNUSED) {
+        newIndex[prim.object] = static_cast<uint32_t>(sorted.size());
+        sorted.push_back(shapes[prim.object]);
+      }
+      prim.object = newIndex[prim.object];
+    }
+    for (size_t i = 0; i < shapes.size(); ++i) {
+      if (newIndex[i] == UNUSED) sorted.push_back(shapes[i]);
+    }
+    shapes = std::move(sorted);
+  };
+  reorderShapes(spheres, PrimRef::SPHERE);
+  reorderShapes(triangles, PrimRef::TRIANGLE);
+  reorderShapes(cylinders, PrimRef::CYLINDER);
+  reorderShapes(fields, PrimRef::DISTANCE_FIELD);
+
+  // Index buffers of meshes are reordered a whole face at a time
+  auto reorderFaces = [&](auto& meshes, uint32_t type, size_t corners) {
+    const auto order = elementOrder(type, meshes.size(), [&](size_t m) {
+      return meshes[m].indices.size() / corners;
+    });
+    for (size_t m = 0; m < meshes.size(); ++m) {
+      std::vector<uint32_t> indices;
+      indices.reserve(meshes[m].indices.size());
+      for (const uint32_t old : order[m]) {
+        const auto face = meshes[m].indices.begin() + old * corners;
+        indices.insert(indices.end(), face, face + corners);
+      }
+      meshes[m].indices = std::move(indices);
+    }
+  };
+  reorderFaces(meshes, PrimRef::MESH_TRIANGLE, 3);
+  reorderFaces(quadMeshes, PrimRef::MESH_QUAD, 4);
+  reorderFaces(compressedMeshes, PrimRef::COMPRESSED_TRIANGLE, 3);
+
+  const auto order =
+      elementOrder(PrimRef::SET_SPHERE, sphereSets.size(),
+                   [&](size_t s) { return sphereSets[s].packCount(); });
+  for (size_t s = 0; s < sphereSets.size(); ++s) {
+    SphereSet& set = sphereSets[s];
+    std::vector<SpherePack> packs;
+    std::vector<Vector> origins;
+    packs.reserve(set.packs.size());
+    origins.reserve(set.origins.size());
+    for (const uint32_t old : order[s]) {
+      packs.push_back(set.packs[old]);
+      origins.push_back(set.origins[old]);
+    }
+    set.packs = std::move(packs);
+    set.origins = std::move(origins);
+  }
+}
+
+// Bounds of every bounded shape, mesh, sphere set and instance
+Bounds Scene::bounds() const {
+  Bounds b;
+  auto expandAll = [&](const auto& shapes) {
+    for (const auto& shape : shapes) b.expand(shape.bounds());
+  };
+  expandAll(spheres);
+  expandAll(triangles);
+  expandAll(cylinders);
+  expandAll(fields);
+  for (const TriangleMesh& mesh : meshes) {
+    for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+      b.expand(mesh.triangleBounds(t));
+    }
+  }
+  for (const QuadMesh& mesh : quadMeshes) {
+    for (size_t q = 0; q < mesh.quadCount(); ++q) b.expand(mesh.quadBounds(q));
+  }
+  for (const CompressedMesh& mesh : compressedMeshes) {
+    for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+      b.expand(mesh.triangleBounds(t));
+    }
+  }
+  for (const SphereSet& set : sphereSets) {
+    for (size_t p = 0; p < set.packCount(); ++p) b.expand(set.packBounds(p));
+  }
+  for (const Instance& instance : instances) b.expand(instance.bounds());
+  return b;
+}
+
+// Intersect ray with the primitive referenced by prim
+// On a hit, sets hit to its distance, prim and surface coordinates. Shape
+// classes are final, so each case is a direct (inlinable) call.
+bool Scene::intersect(const PrimRef& prim, const Ray& ray, Hit& hit) const {
+  double t, u, v;
+  bool found;
+  switch (prim.type) {
+    case PrimRef::SPHERE:
+      found = spheres[prim.object].intersect(ray, t, u, v);
+      break;
+    case PrimRef::TRIANGLE:
+      found = triangles[prim.object].intersect(ray, t, u, v);
+      break;
+    case PrimRef::CYLINDER:
+      found = cylinders[prim.object].intersect(ray, t, u, v);
+      break;
+    case PrimRef::PLANE:
+      found = planes[prim.object].intersect(ray, t, u, v);
+      break;
+    case PrimRef::DISTANCE_FIELD:
+      found = fields[prim.object].intersect(ray, t, u, v);
+      break;
+    case PrimRef::SET_SPHERE:
+      found = sphereSets[prim.object].intersect(prim.element, ray, t, u, v);
+      break;
+    case PrimRef::MESH_QUAD:
+      found = quadMeshes[prim.object].intersect(prim.element, ray, t, u, v);
+      break;
+    case PrimRef::COMPRESSED_TRIANGLE:
+      found = compressedMeshes[prim.object].intersect(prim.element, ray, t, u,
+                                                      v);
+      break;
+    case PrimRef::INSTANCE: {
+      // Level of detail follows the pixel footprint seen from the pass's
+      // camera, except that rays leaving a hit on this instance keep its level
+      const Instance& instance = instances[prim.object];
+      const LodHit& from = getLodHit();
+      const LodView& view = getLodView();
+      const size_t level =
+          from.instance == &instance
+              ? from.level
+              : instance.selectLevel(ray, view.eye, view.spread);
+      found = instance.intersect(ray, level, t, u, v);
+      break;
+    }
+    default:
+      found = meshes[prim.object].intersect(prim.element, ray, t, u, v);
+      break;
+  }
+  if (!found) return false;
+  hit = Hit{t, prim, u, v};
+  return true;
+}
+
+// Instance and level of detail of a hit, for the rays that leave it
+LodHit Scene::lodHit(const Hit& hit) const {
+  if (hit.prim.type != PrimRef::INSTANCE) return LodHit{};
+  return LodHit{&instances[hit.prim.object], static_cast<size_t>(hit.u)};
+}
+
+// Position, normal and material of a hit found by intersect
+HitInfo Scene::hitInfo(const Hit& hit, const Ray& ray) const {
+  const PrimRef& prim = hit.prim;
+  switch (prim.type) {
+    case PrimRef::SPHERE:
+      return spheres[prim.object].hitInfo(ray, hit.t, hit.u, hit.v);
+    case PrimRef::TRIANGLE:
+      return triangles[prim.object].hitInfo(ray, hit.t, hit.u, hit.v);
+    case PrimRef::CYLINDER:
+      return cylinders[prim.object].hitInfo(ray, hit.t, hit.u, hit.v);
+    case PrimRef::PLANE:
+      return planes[prim.object].hitInfo(ray, hit.t, hit.u, hit.v);
+    case PrimRef::DISTANCE_FIELD:
+      return fields[prim.object].hitInfo(ray, hit.t, hit.u, hit.v);
+    case PrimRef::SET_SPHERE:
+      return sphereSets[prim.object].hitInfo(prim.element, ray, hit.t, hit.u,
+                                             hit.v);
+    case PrimRef::MESH_QUAD:
+      return quadMeshes[prim.object].hitInfo(prim.element, ray, hit.t, hit.u,
+                                             hit.v);
+    case PrimRef::COMPRESSED_TRIANGLE:
+      return compressedMeshes[prim.object].hitInfo(prim.element, ray, hit.t,
+                                                   hit.u, hit.v);
+    case PrimRef::INSTANCE:
+      return instances[prim.object].hitInfo(ray, hit.t, hit.u, hit.v);
+    default:
+      return meshes[prim.object].hitInfo(prim.element, ray, hit.t, hit.u,
+                                         hit.v);
+  }
 }
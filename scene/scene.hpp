@@ -1,47 +1,123 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <limits>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "math/camera.hpp"
 #include "math/color.hpp"
+#include "math/ray.hpp"
+#include "math/transform.hpp"
 #include "math/vector.hpp"
+#include "scene/instance.hpp"
 #include "scene/light.hpp"
 #include "scene/material.hpp"
+#include "shapes/cylinder.hpp"
+#include "shapes/mesh.hpp"
 #include "shapes/plane.hpp"
+#include "shapes/quad.hpp"
+#include "shapes/sdf.hpp"
 #include "shapes/shape.hpp"
+#include "shapes/sphere.hpp"
+#include "shapes/triangle.hpp"
+
+// Algorithm used to build the BVH over the scene's bounded shapes
+enum class BVHBuildMethod {
+  BINNED_SAH,  // Top-down binned surface area heuristic (fast, default)
+  PLOC,        // Bottom-up parallel locally-ordered clustering (higher quality)
+};
+
+// Order in which the tracer works through the rays of a frame
+enum class TraceMode {
+  DEPTH_FIRST,  // Each sample's whole path is traced before the next (default)
+  WAVEFRONT,    // Batches of rays are traced stage by stage, one bounce at once
+};
+
+// Sequence the positions of samples within pixels are drawn from
+enum class SamplerType {
+  STRATIFIED,  // Pixel center, then jittered 2x2 grid cells
+  SOBOL,       // Owen-scrambled Sobol (default)
+  HALTON,      // Randomly shifted Halton
+  LATTICE,     // Rank-1 lattice shifted by blue noise
+};
+
+// Reference from the BVH to a single bounded primitive of the scene
+struct PrimRef {
+  static constexpr uint32_t SPHERE = 0;         // Object indexes spheres
+  static constexpr uint32_t TRIANGLE = 1;       // Object indexes triangles
+  static constexpr uint32_t CYLINDER = 2;       // Object indexes cylinders
+  static constexpr uint32_t MESH_TRIANGLE = 3;  // Object indexes meshes
+  static constexpr uint32_t PLANE = 4;          // Object indexes planes
+  static constexpr uint32_t SET_SPHERE = 5;     // Object indexes sphere sets
+  static constexpr uint32_t INSTANCE = 6;       // Object indexes instances
+  static constexpr uint32_t MESH_QUAD = 7;      // Object indexes quad meshes
+  static constexpr uint32_t DISTANCE_FIELD = 8;  // Object indexes fields
+  static constexpr uint32_t COMPRESSED_TRIANGLE = 9;  // Compressed meshes
+
+  uint32_t type : 4;
+  uint32_t object : 28;  // Index into the scene array selected by type
+  uint32_t element;      // Face of a mesh or pack of a set (0 for shapes)
+};
+
+// Candidate hit found while searching for the closest one
+// Only the distance, primitive and surface coordinates are recorded; position,
+// normal and material are resolved by Scene::hitInfo once, for the final hit
+struct Hit {
+  double t = std::numeric_limits<double>::max();
+  PrimRef prim = {};
+  double u = 0.0;
+  double v = 0.0;
+};
 
 // Represents the entire 3D scene to be rendered
 class Scene {
  private:
+  // Standard error of a pixel's luminance it is refined to, about half of
+  // one 8-bit level
+  static constexpr double DEFAULT_NOISE_THRESHOLD = 0.002;
   const int width;
   const int height;
   const int maxReflections;
   double ambientLight;
+  BVHBuildMethod bvhMethod = BVHBuildMethod::BINNED_SAH;
+  TraceMode traceMode = TraceMode::DEPTH_FIRST;
+  double noiseThreshold = DEFAULT_NOISE_THRESHOLD;
+  int tileSize = 0;  // Side of the square tiles passes are split into
+  SamplerType samplerType = SamplerType::SOBOL;
+  uint32_t seed = 0;  // Key of all random numbers used while rendering
   Camera camera;
   Color background;
   std::vector<Light> lights;
-  std::vector<std::unique_ptr<BoundedShape>> bndedShapes;
-  std::vector<std::unique_ptr<Plane>> planes;
+  // Shapes are stored by value in one contiguous array per type
+  std::vector<Sphere> spheres;
+  std::vector<Triangle> triangles;
+  std::vector<Cylinder> cylinders;
+  std::vector<Plane> planes;
+  std::vector<DistanceField> fields;
+  std::vector<TriangleMesh> meshes;
+  std::vector<QuadMesh> quadMeshes;
+  std::vector<CompressedMesh> compressedMeshes;
+  std::vector<SphereSet> sphereSets;
+  std::vector<Instance> instances;
   std::vector<Material> materials;
+  // Index in materials of each distinct material added with a shape
+  std::unordered_map<Material, size_t, MaterialHash> materialIndices;
+  // Index of each instanced prototype's first material in materials
+  std::unordered_map<const Prototype*, size_t> prototypeMaterials;
 
-  template <typename ShapeT, typename... Args>
-  void addBoundedShape(const Material& m, Args&&... args) {
-    materials.push_back(m);
-    size_t matIndex = materials.size() - 1;
-    bndedShapes.push_back(
-        std::make_unique<ShapeT>(std::forward<Args>(args)..., matIndex));
-  }
+  size_t internMaterial(const Material& m);
+  void reorderPrimitives(std::vector<PrimRef>& prims);
 
-  void addPlaneShape(const Material& m, const Vector& point,
-                     const Vector& normal) {
-    materials.push_back(m);
-    size_t matIndex = materials.size() - 1;
-    planes.push_back(std::make_unique<Plane>(point, normal, matIndex));
+  template <typename ShapeT, typename... Args>
+  void addShape(std::vector<ShapeT>& shapes, const Material& m,
+                Args&&... args) {
+    shapes.emplace_back(std::forward<Args>(args)..., internMaterial(m));
   }
 
  public:
@@ -58,22 +134,28 @@ class Scene {
         height(other.height),
         maxReflections(other.maxReflections),
         ambientLight(other.ambientLight),
+        bvhMethod(other.bvhMethod),
+        traceMode(other.traceMode),
+        noiseThreshold(other.noiseThreshold),
+        tileSize(other.tileSize),
+        samplerType(other.samplerType),
+        seed(other.seed),
         camera(other.camera),
         background(other.background),
         lights(other.lights),
-        bndedShapes(),
-        planes(),
-        materials(other.materials) {
-    // Deep copy of bounded shapes
-    for (const std::unique_ptr<BoundedShape>& bshape : other.bndedShapes) {
-      bndedShapes.push_back(std::unique_ptr<BoundedShape>(
-          static_cast<BoundedShape*>(bshape->clone())));
-    }
-    // Deep copy of planes
-    for (const std::unique_ptr<Plane>& shape : other.planes) {
-      planes.push_back(std::unique_ptr<Plane>(shape->clone()));
-    }
-  }
+        spheres(other.spheres),
+        triangles(other.triangles),
+        cylinders(other.cylinders),
+        planes(other.planes),
+        fields(other.fields),
+        meshes(other.meshes),
+        quadMeshes(other.quadMeshes),
+        compressedMeshes(other.compressedMeshes),
+        sphereSets(other.sphereSets),
+        instances(other.instances),
+        materials(other.materials),
+        materialIndices(other.materialIndices),
+        prototypeMaterials(other.prototypeMaterials) {}
 
   int getWidth() const { return width; }
   int getHeight() const { return height; }
@@ -81,13 +163,47 @@ class Scene {
   double getAmbientLight() const { return ambientLight; }
   const Color getBackground() const { return background; }
   const Camera getCamera() const { return camera; }
+  LodView lodView() const;
+  BVHBuildMethod getBVHBuildMethod() const { return bvhMethod; }
+  TraceMode getTraceMode() const { return traceMode; }
+  double getNoiseThreshold() const { return noiseThreshold; }
+  int getTileSize() const { return tileSize; }
+  SamplerType getSamplerType() const { return samplerType; }
+  uint32_t getSeed() const { return seed; }
 
   size_t lightCount() const { return lights.size(); }
   size_t planeCount() const { return planes.size(); }
-  size_t boundedShapeCount() const { return bndedShapes.size(); }
-  size_t shapeCount() const { return planeCount() + boundedShapeCount(); }
+  size_t boundedShapeCount() const {
+    return spheres.size() + triangles.size() + cylinders.size() +
+           fields.size() + instances.size();
+  }
+  size_t meshCount() const { return meshes.size(); }
+  size_t meshTriangleCount() const;
+  size_t quadMeshCount() const { return quadMeshes.size(); }
+  size_t compressedMeshCount() const { return compressedMeshes.size(); }
+  size_t compressedTriangleCount() const;
+  size_t meshQuadCount() const;
+  size_t sphereSetCount() const { return sphereSets.size(); }
+  size_t setSphereCount() const;
+  size_t instanceCount() const { return instances.size(); }
+  size_t materialCount() const { return materials.size(); }
+  size_t shapeCount() const {
+    return planeCount() + boundedShapeCount() + meshTriangleCount() +
+           meshQuadCount() + compressedTriangleCount() + setSphereCount();
+  }
+
+  Bounds bounds() const;
+  bool intersect(const PrimRef& prim, const Ray& ray, Hit& hit) const;
+  HitInfo hitInfo(const Hit& hit, const Ray& ray) const;
+  LodHit lodHit(const Hit& hit) const;
 
   void setAmbientLight(const double ambient);
+  void setBVHBuildMethod(const BVHBuildMethod method);
+  void setTraceMode(const TraceMode mode);
+  void setNoiseThreshold(const double threshold);
+  void setTileSize(const int size);
+  void setSamplerType(const SamplerType type);
+  void setSeed(const uint32_t s);
   void setCamera(const Vector pos, const Vector dir, const double fovDeg);
   void setCameraPos(const Vector pos);
   void setCameraDir(const Vector dir);
@@ -106,13 +222,32 @@ class Scene {
                    const Vector& nA, const Vector& nB, const Vector& nC,
                    const Material& mat);
   void addCylinder(const Vector& c, double r, double h, const Material& m);
+  void addDistanceField(DistanceFunction distance, const Vector& bmin,
+                        const Vector& bmax, double lipschitz,
+                        const Material& mat, int maxSteps = 256,
+                        double tolerance = 1e-4);
+  void addMesh(std::vector<Vector> positions, std::vector<Vector> normals,
+               std::vector<uint32_t> indices, const Material& mat);
+  // Replace every triangle mesh added so far with a compressed copy
+  void compressMeshes();
+  void addQuadMesh(std::vector<Vector> positions, std::vector<Vector> normals,
+                   std::vector<uint32_t> indices, const Material& mat);
+  void addSphereSet(const std::vector<Vector>& centers,
+                    const std::vector<double>& radii, const Material& mat);
+  size_t addInstance(std::shared_ptr<const Prototype> prototype,
+                     const Transform& transform);
+  void setInstanceTransform(size_t instance, const Transform& transform);
+  // lodLevels > 0 adds the mesh as an instance with that many simplified
+  // levels of detail, traced when its triangles are smaller than a pixel
   bool importOBJ(const Vector& offset, const std::string fileName,
-                 const double scale, const Material& material);
+                 const double scale, const Material& material,
+                 int lodLevels = 0);
 
   friend class Tracer;
   friend class Renderer;
   friend class Converter;
   friend class BVH;
+  friend class Prototype;
 
   ~Scene() = default;
 };
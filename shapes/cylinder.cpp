@@ -4,20 +4,22 @@
 
 #include <algorithm>
 #include <cmath>
-#include <optional>
 
 #include "math/ray.hpp"
 #include "shapes/shape.hpp"
 
 Cylinder::Cylinder(const Vector& c, double r, double h, size_t matIndex)
-    : BoundedShape(c - Vector(r, r, h * 0.5), c + Vector(r, r, h * 0.5),
-                   matIndex),
-      center(c),
-      radius(r),
-      height(h) {}
+    : BoundedShape(matIndex), center(c), radius(r), height(h) {}
+
+Bounds Cylinder::bounds() const {
+  const Vector extent(radius, radius, height * 0.5);
+  return Bounds(center - extent, center + extent);
+}
 
 // Ray–cylinder intersection
-std::optional<HitInfo> Cylinder::intersects(const Ray& ray) const {
+// u is set to the surface hit: 1 = side, 2 = top cap, 3 = bottom cap
+bool Cylinder::intersect(const Ray& ray, double& t, double& u,
+                         double& v) const {
   const double EPS = Vector::EPS;
 
   Vector o = ray.orig - center;
@@ -72,7 +74,7 @@ std::optional<HitInfo> Cylinder::intersects(const Ray& ray) const {
   double tTop = cap(zMax);
   double tBottom = cap(zMin);
 
-  double t = 1e30;
+  t = 1e30;
   int type = 0;
 
   if (tSide > 0.0 && tSide < t) {
@@ -88,15 +90,22 @@ std::optional<HitInfo> Cylinder::intersects(const Ray& ray) const {
     type = 3;
   }
 
-  if (type == 0) return std::nullopt;
+  if (type == 0) return false;
+
+  u = type;
+  v = 0.0;
+  return true;
+}
 
+// Calculate intersection details for the surface selected by u
+HitInfo Cylinder::hitInfo(const Ray& ray, double t, double u, double) const {
   Vector pos = ray.at(t);
   Vector normal;
 
-  if (type == 1) {
+  if (u == 1.0) {
     Vector pLocal = pos - center;
     normal = Vector(pLocal.x(), pLocal.y(), 0.0).norm();
-  } else if (type == 2) {
+  } else if (u == 2.0) {
     normal = Vector(0.0, 0.0, 1.0);
   } else {
     normal = Vector(0.0, 0.0, -1.0);
@@ -7,7 +7,7 @@
 
 // A finite vertical cylinder aligned with the Z-axis.
 
-class Cylinder : public BoundedShape {
+class Cylinder final : public BoundedShape {
  public:
   Vector center;  // geometric center
   double radius;  // radius in the xy-plane
@@ -15,7 +15,11 @@ class Cylinder : public BoundedShape {
 
   Cylinder(const Vector& c, double r, double h, size_t matIndex);
 
-  std::optional<HitInfo> intersects(const Ray& ray) const override;
+  bool intersect(const Ray& ray, double& t, double& u,
+                 double& v) const override;
+  HitInfo hitInfo(const Ray& ray, double t, double u,
+                  double v) const override;
+  Bounds bounds() const override;
 
   int getShapeType() const override { return Shape::CYLINDER; }
 
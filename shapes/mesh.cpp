@@ -0,0 +1,502 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <utility>
+
+#include "math/morton.hpp"
+#include "math/ray.hpp"
+#include "shapes/triangle.hpp"
+
+TriangleMesh::TriangleMesh(std::vector<Vector> pos, std::vector<Vector> norms,
+                           std::vector<uint32_t> idx, const size_t matIndex)
+    : positions(std::move(pos)),
+      normals(std::move(norms)),
+      indices(std::move(idx)),
+      materialIndex(matIndex) {}
+
+// Bounding box of a single triangle
+Bounds TriangleMesh::triangleBounds(size_t tri) const {
+  const Vector& a = positions[indices[3 * tri]];
+  const Vector& b = positions[indices[3 * tri + 1]];
+  const Vector& c = positions[indices[3 * tri + 2]];
+  return Bounds(a.min(b).min(c), a.max(b).max(c));
+}
+
+// Calculate intersection of ray with one triangle of the mesh
+// Sets distance t and barycentric weights u, v of the 2nd/3rd vertex
+bool TriangleMesh::intersect(size_t tri, const Ray& ray, double& t, double& u,
+                             double& v) const {
+  const Vector& a = positions[indices[3 * tri]];
+  const Vector& b = positions[indices[3 * tri + 1]];
+  const Vector& c = positions[indices[3 * tri + 2]];
+
+#ifdef WATERTIGHT_TRIANGLES
+  return intersectTriangleWatertight(ray, a, b, c, t, u, v);
+#else
+  return intersectTriangle(ray, a, b - a, c - a, t, u, v);
+#endif
+}
+
+// Calculate intersection details of a hit found by intersect
+HitInfo TriangleMesh::hitInfo(size_t tri, const Ray& ray, double t, double u,
+                              double v) const {
+  return HitInfo{ray.at(t), normalAt(tri, u, v), ray, t, materialIndex};
+}
+
+// Intersect and resolve the hit details in one step
+std::optional<HitInfo> TriangleMesh::intersects(size_t tri,
+                                                const Ray& ray) const {
+  double t, u, v;
+  if (!intersect(tri, ray, t, u, v)) return std::nullopt;
+  return hitInfo(tri, ray, t, u, v);
+}
+
+// Interpolated vertex normal, or face normal if any vertex lacks a normal
+Vector TriangleMesh::normalAt(size_t tri, double u, double v) const {
+  const uint32_t i0 = indices[3 * tri];
+  const uint32_t i1 = indices[3 * tri + 1];
+  const uint32_t i2 = indices[3 * tri + 2];
+
+  const Vector zero;
+  if (normals.empty() || normals[i0] == zero || normals[i1] == zero ||
+      normals[i2] == zero) {
+    const Vector& a = positions[i0];
+    return (positions[i1] - a).cross(positions[i2] - a).norm();
+  }
+  return (normals[i0] * (1 - u - v) + normals[i1] * u + normals[i2] * v)
+      .norm();
+}
+
+// Sum of squared distances to a set of weighted planes, as the symmetric 4x4
+// matrix of Garland and Heckbert (upper triangle, row by row)
+struct Quadric {
+  double q[10] = {};
+
+  // Plane n.p + d = 0 with unit normal n
+  void addPlane(const Vector& n, double d, double weight) {
+    const double p[4] = {n.x(), n.y(), n.z(), d};
+    int k = 0;
+    for (int r = 0; r < 4; ++r) {
+      for (int c = r; c < 4; ++c) q[k++] += weight * p[r] * p[c];
+    }
+  }
+
+  void add(const Quadric& other) {
+    for (int k = 0; k < 10; ++k) q[k] += other.q[k];
+  }
+
+  double error(const Vector& p) const {
+    const double x = p.x(), y = p.y(), z = p.z();
+    return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z +
+           2 * q[3] * x + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+           q[7] * z * z + 2 * q[8] * z + q[9];
+  }
+
+  // Point of least error; false if the quadric is too flat to solve for one
+  bool optimum(Vector& p) const {
+    const double a = q[0], b = q[1], c = q[2], d = q[4], e = q[5], f = q[7];
+    const double det = a * (d * f - e * e) - b * (b * f - c * e) +
+                       c * (b * e - c * d);
+    if (std::abs(det) < 1e-12 * (a * d * f + Vector::EPS)) return false;
+    const double rx = -q[3], ry = -q[6], rz = -q[8];
+    p = Vector((rx * (d * f - e * e) - b * (ry * f - e * rz) +
+                c * (ry * e - d * rz)) /
+                   det,
+               (a * (ry * f - e * rz) - rx * (b * f - c * e) +
+                c * (b * rz - ry * c)) /
+                   det,
+               (a * (d * rz - ry * e) - b * (b * rz - ry * c) +
+                rx * (b * e - c * d)) /
+                   det);
+    return true;
+  }
+};
+
+// Candidate collapse of edge (a, b) into position target
+struct EdgeCollapse {
+  double cost;
+  uint32_t a, b;
+  uint32_t stampA, stampB;  // Vertex stamps when the cost was computed
+  Vector target;
+
+  bool operator>(const EdgeCollapse& other) const { return cost > other.cost; }
+};
+
+// Boundary edges weigh this much more than surface planes, so open borders
+// keep their shape instead of shrinking
+static constexpr double BOUNDARY_WEIGHT = 1000.0;
+
+// Vertices that share a position are welded first, so seams between vertices
+// with different normals do not tear open. Collapses that would flip a
+// triangle or join two sheets of the surface are skipped.
+TriangleMesh TriangleMesh::simplified(size_t targetTriangles) const {
+  // Weld vertices at identical positions
+  std::vector<uint32_t> order(positions.size());
+  std::iota(order.begin(), order.end(), 0);
+  auto less = [&](uint32_t i, uint32_t j) {
+    const Vector& p = positions[i];
+    const Vector& q = positions[j];
+    if (p.x() != q.x()) return p.x() < q.x();
+    if (p.y() != q.y()) return p.y() < q.y();
+    return p.z() < q.z();
+  };
+  std::sort(order.begin(), order.end(), less);
+  std::vector<uint32_t> weld(positions.size());
+  std::vector<Vector> pos;
+  std::vector<Vector> normalSum;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (i == 0 || positions[order[i - 1]] != positions[order[i]]) {
+      pos.push_back(positions[order[i]]);
+      normalSum.push_back(Vector());
+    }
+    weld[order[i]] = static_cast<uint32_t>(pos.size() - 1);
+    if (!normals.empty()) normalSum.back() += normals[order[i]];
+  }
+
+  // Faces over welded vertices, skipping any that are already degenerate
+  std::vector<std::array<uint32_t, 3>> faces;
+  for (size_t t = 0; t < triangleCount(); ++t) {
+    const std::array<uint32_t, 3> f = {weld[indices[3 * t]],
+                                       weld[indices[3 * t + 1]],
+                                       weld[indices[3 * t + 2]]};
+    if (f[0] != f[1] && f[1] != f[2] && f[0] != f[2]) faces.push_back(f);
+  }
+  std::vector<bool> faceAlive(faces.size(), true);
+  size_t liveFaces = faces.size();
+  std::vector<std::vector<uint32_t>> vertexFaces(pos.size());
+  for (size_t f = 0; f < faces.size(); ++f) {
+    for (const uint32_t v : faces[f]) vertexFaces[v].push_back(f);
+  }
+
+  auto faceNormal = [&](const std::array<uint32_t, 3>& f) {
+    return (pos[f[1]] - pos[f[0]]).cross(pos[f[2]] - pos[f[0]]);
+  };
+
+  // Plane of every face, weighted by area, plus planes holding borders
+  std::vector<Quadric> quadrics(pos.size());
+  std::vector<std::pair<uint64_t, uint32_t>> edges;
+  for (size_t f = 0; f < faces.size(); ++f) {
+    const Vector n = faceNormal(faces[f]);
+    const double area = 0.5 * n.mag();
+    if (area <= 0.0) continue;
+    const Vector unit = n.norm();
+    for (const uint32_t v : faces[f]) {
+      quadrics[v].addPlane(unit, -(unit * pos[faces[f][0]]), area);
+    }
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t a = faces[f][k], b = faces[f][(k + 1) % 3];
+      const uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) |
+                           std::max(a, b);
+      edges.emplace_back(key, f);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  for (size_t i = 0; i < edges.size(); ++i) {
+    const bool shared = (i > 0 && edges[i - 1].first == edges[i].first) ||
+                        (i + 1 < edges.size() &&
+                         edges[i + 1].first == edges[i].first);
+    if (shared) continue;
+    const uint32_t a = edges[i].first >> 32;
+    const uint32_t b = static_cast<uint32_t>(edges[i].first);
+    const Vector edge = pos[b] - pos[a];
+    const Vector side = edge.cross(faceNormal(faces[edges[i].second]));
+    if (side.magSq() <= 0.0) continue;
+    const Vector unit = side.norm();
+    const double weight = BOUNDARY_WEIGHT * edge.magSq();
+    quadrics[a].addPlane(unit, -(unit * pos[a]), weight);
+    quadrics[b].addPlane(unit, -(unit * pos[a]), weight);
+  }
+
+  // Queue every edge by the error of collapsing it
+  std::vector<uint32_t> stamps(pos.size(), 0);
+  std::vector<bool> vertexAlive(pos.size(), true);
+  std::priority_queue<EdgeCollapse, std::vector<EdgeCollapse>,
+                      std::greater<EdgeCollapse>>
+      queue;
+  auto push = [&](uint32_t a, uint32_t b) {
+    Quadric q = quadrics[a];
+    q.add(quadrics[b]);
+    Vector target;
+    if (!q.optimum(target)) target = (pos[a] + pos[b]) * 0.5;
+    // Fall back to an endpoint if the solution is worse than both
+    for (const Vector& candidate : {pos[a], pos[b]}) {
+      if (q.error(candidate) < q.error(target)) target = candidate;
+    }
+    queue.push(EdgeCollapse{std::max(q.error(target), 0.0), a, b, stamps[a],
+                            stamps[b], target});
+  };
+  for (size_t i = 0; i < edges.size(); ++i) {
+    if (i > 0 && edges[i - 1].first == edges[i].first) continue;
+    push(edges[i].first >> 32, static_cast<uint32_t>(edges[i].first));
+  }
+
+  // Distinct vertices sharing a live face with v
+  auto neighbors = [&](uint32_t v) {
+    std::vector<uint32_t> out;
+    for (const uint32_t f : vertexFaces[v]) {
+      if (!faceAlive[f]) continue;
+      for (const uint32_t w : faces[f]) {
+        if (w != v) out.push_back(w);
+      }
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  };
+
+  while (liveFaces > targetTriangles && !queue.empty()) {
+    const EdgeCollapse c = queue.top();
+    queue.pop();
+    if (!vertexAlive[c.a] || !vertexAlive[c.b] || stamps[c.a] != c.stampA ||
+        stamps[c.b] != c.stampB) {
+      continue;
+    }
+
+    // Only collapse edges whose endpoints share exactly their two faces'
+    // opposite vertices (one for a border), which keeps the surface manifold
+    const std::vector<uint32_t> na = neighbors(c.a), nb = neighbors(c.b);
+    std::vector<uint32_t> common;
+    std::set_intersection(na.begin(), na.end(), nb.begin(), nb.end(),
+                          std::back_inserter(common));
+    if (common.size() > 2) continue;
+
+    // Reject collapses that turn a surviving face over
+    bool flips = false;
+    for (const uint32_t v : {c.a, c.b}) {
+      for (const uint32_t f : vertexFaces[v]) {
+        if (!faceAlive[f]) continue;
+        std::array<uint32_t, 3> face = faces[f];
+        if (std::count(face.begin(), face.end(), c.a) +
+                std::count(face.begin(), face.end(), c.b) ==
+            2) {
+          continue;  // Removed by this collapse
+        }
+        const Vector before = faceNormal(face);
+        const Vector saved = pos[v];
+        pos[v] = c.target;
+        const Vector after = faceNormal(face);
+        pos[v] = saved;
+        if (before * after <= 0.0) flips = true;
+      }
+    }
+    if (flips) continue;
+
+    // Merge b into a
+    pos[c.a] = c.target;
+    quadrics[c.a].add(quadrics[c.b]);
+    normalSum[c.a] += normalSum[c.b];
+    vertexAlive[c.b] = false;
+    stamps[c.a]++;
+    for (const uint32_t f : vertexFaces[c.b]) {
+      if (!faceAlive[f]) continue;
+      std::array<uint32_t, 3>& face = faces[f];
+      if (std::find(face.begin(), face.end(), c.a) != face.end()) {
+        faceAlive[f] = false;
+        liveFaces--;
+        continue;
+      }
+      std::replace(face.begin(), face.end(), c.b, c.a);
+      vertexFaces[c.a].push_back(f);
+    }
+    std::vector<uint32_t>& aFaces = vertexFaces[c.a];
+    aFaces.erase(std::remove_if(aFaces.begin(), aFaces.end(),
+                                [&](uint32_t f) { return !faceAlive[f]; }),
+                 aFaces.end());
+    std::vector<uint32_t>().swap(vertexFaces[c.b]);
+    for (const uint32_t w : neighbors(c.a)) push(c.a, w);
+  }
+
+  // Compact the surviving vertices and faces
+  std::vector<uint32_t> remap(pos.size(), UINT32_MAX);
+  std::vector<Vector> outPositions, outNormals;
+  std::vector<uint32_t> outIndices;
+  for (size_t f = 0; f < faces.size(); ++f) {
+    if (!faceAlive[f]) continue;
+    for (const uint32_t v : faces[f]) {
+      if (remap[v] == UINT32_MAX) {
+        remap[v] = static_cast<uint32_t>(outPositions.size());
+        outPositions.push_back(pos[v]);
+        if (!normals.empty()) {
+          outNormals.push_back(normalSum[v].magSq() > 0.0
+                                   ? normalSum[v].norm()
+                                   : Vector());
+        }
+      }
+      outIndices.push_back(remap[v]);
+    }
+  }
+  return TriangleMesh(std::move(outPositions), std::move(outNormals),
+                      std::move(outIndices), materialIndex);
+}
+
+double TriangleMesh::meanEdgeLength() const {
+  if (indices.empty()) return 0.0;
+  double sum = 0.0;
+  for (size_t t = 0; t < triangleCount(); ++t) {
+    const Vector& a = positions[indices[3 * t]];
+    const Vector& b = positions[indices[3 * t + 1]];
+    const Vector& c = positions[indices[3 * t + 2]];
+    sum += (b - a).mag() + (c - b).mag() + (a - c).mag();
+  }
+  return sum / (3.0 * triangleCount());
+}
+
+// Vertices are reordered along a Morton curve over the mesh bounds first, so
+// each cluster covers a small part of the mesh and quantizes finely
+CompressedMesh::CompressedMesh(const TriangleMesh& mesh)
+    : materialIndex(mesh.materialIndex) {
+  const size_t count = mesh.positions.size();
+  Bounds meshBounds;
+  for (const Vector& p : mesh.positions) meshBounds.expand(p);
+  const Vector extent = meshBounds.max - meshBounds.min;
+  const Vector invExtent(extent.x() > 0.0 ? 1.0 / extent.x() : 0.0,
+                         extent.y() > 0.0 ? 1.0 / extent.y() : 0.0,
+                         extent.z() > 0.0 ? 1.0 / extent.z() : 0.0);
+  std::vector<uint64_t> codes(count);
+  for (size_t i = 0; i < count; ++i) {
+    const Vector rel = mesh.positions[i] - meshBounds.min;
+    codes[i] = mortonCode(Vector(rel.x() * invExtent.x(),
+                                 rel.y() * invExtent.y(),
+                                 rel.z() * invExtent.z()));
+  }
+  std::vector<uint32_t> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return codes[a] < codes[b] || (codes[a] == codes[b] && a < b);
+  });
+
+  std::vector<uint32_t> newIndex(count);
+  for (size_t i = 0; i < count; ++i) newIndex[order[i]] = i;
+  indices.reserve(mesh.indices.size());
+  for (const uint32_t index : mesh.indices) {
+    indices.push_back(newIndex[index]);
+  }
+
+  // Quantize each cluster to 16 bits per axis within its own box
+  constexpr double LEVELS = 65535.0;
+  positions.reserve(3 * count);
+  for (size_t first = 0; first < count; first += CLUSTER_SIZE) {
+    const size_t last = std::min(count, first + CLUSTER_SIZE);
+    Bounds box;
+    for (size_t i = first; i < last; ++i) {
+      box.expand(mesh.positions[order[i]]);
+    }
+    const Vector size = box.max - box.min;
+    clusters.push_back(Cluster{box.min, size / LEVELS});
+    for (size_t i = first; i < last; ++i) {
+      const Vector rel = mesh.positions[order[i]] - box.min;
+      for (int axis = 0; axis < 3; ++axis) {
+        const double q = size[axis] > 0.0 ? rel[axis] / size[axis] : 0.0;
+        positions.push_back(
+            static_cast<uint16_t>(std::lround(std::clamp(q, 0.0, 1.0) *
+                                              LEVELS)));
+      }
+    }
+  }
+
+  if (!mesh.normals.empty()) {
+    normals.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      normals.push_back(encodeOctahedral(mesh.normals[order[i]]));
+    }
+  }
+}
+
+// Decoded position of one vertex
+Vector CompressedMesh::position(uint32_t vertex) const {
+  const Cluster& cluster = clusters[vertex / CLUSTER_SIZE];
+  const uint16_t* q = &positions[3 * vertex];
+  return cluster.min + Vector(q[0] * cluster.step.x(), q[1] * cluster.step.y(),
+                              q[2] * cluster.step.z());
+}
+
+// Bounding box of a single decoded triangle
+Bounds CompressedMesh::triangleBounds(size_t tri) const {
+  const Vector a = position(indices[3 * tri]);
+  const Vector b = position(indices[3 * tri + 1]);
+  const Vector c = position(indices[3 * tri + 2]);
+  return Bounds(a.min(b).min(c), a.max(b).max(c));
+}
+
+// Calculate intersection of ray with one decoded triangle
+// Sets distance t and barycentric weights u, v of the 2nd/3rd vertex
+bool CompressedMesh::intersect(size_t tri, const Ray& ray, double& t,
+                               double& u, double& v) const {
+  const Vector a = position(indices[3 * tri]);
+  const Vector b = position(indices[3 * tri + 1]);
+  const Vector c = position(indices[3 * tri + 2]);
+
+#ifdef WATERTIGHT_TRIANGLES
+  return intersectTriangleWatertight(ray, a, b, c, t, u, v);
+#else
+  return intersectTriangle(ray, a, b - a, c - a, t, u, v);
+#endif
+}
+
+// Calculate intersection details of a hit found by intersect
+HitInfo CompressedMesh::hitInfo(size_t tri, const Ray& ray, double t,
+                                double u, double v) const {
+  return HitInfo{ray.at(t), normalAt(tri, u, v), ray, t, materialIndex};
+}
+
+// Intersect and resolve the hit details in one step
+std::optional<HitInfo> CompressedMesh::intersects(size_t tri,
+                                                  const Ray& ray) const {
+  double t, u, v;
+  if (!intersect(tri, ray, t, u, v)) return std::nullopt;
+  return hitInfo(tri, ray, t, u, v);
+}
+
+// Interpolated vertex normal, or face normal if any vertex lacks a normal
+Vector CompressedMesh::normalAt(size_t tri, double u, double v) const {
+  const uint32_t i0 = indices[3 * tri];
+  const uint32_t i1 = indices[3 * tri + 1];
+  const uint32_t i2 = indices[3 * tri + 2];
+
+  if (normals.empty() || normals[i0] == NO_NORMAL ||
+      normals[i1] == NO_NORMAL || normals[i2] == NO_NORMAL) {
+    const Vector a = position(i0);
+    return (position(i1) - a).cross(position(i2) - a).norm();
+  }
+  return (decodeOctahedral(normals[i0]) * (1 - u - v) +
+          decodeOctahedral(normals[i1]) * u +
+          decodeOctahedral(normals[i2]) * v)
+      .norm();
+}
+
+// Projects n onto the octahedron |x| + |y| + |z| = 1 and unfolds its lower
+// half over the upper one, giving a point in the unit square
+uint32_t encodeOctahedral(const Vector& n) {
+  const double l1 = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+  if (l1 == 0.0) return NO_NORMAL;
+  double x = n.x() / l1, y = n.y() / l1;
+  if (n.z() < 0.0) {
+    const double fx = (1.0 - std::abs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+    const double fy = (1.0 - std::abs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+    x = fx;
+    y = fy;
+  }
+  // 65534 steps keep 0 exactly representable and leave NO_NORMAL unused
+  auto quantize = [](double c) {
+    return static_cast<uint32_t>(std::lround((c * 0.5 + 0.5) * 65534.0));
+  };
+  return quantize(x) << 16 | quantize(y);
+}
+
+Vector decodeOctahedral(uint32_t code) {
+  const double x = (code >> 16) / 32767.0 - 1.0;
+  const double y = (code & 0xffff) / 32767.0 - 1.0;
+  const double z = 1.0 - std::abs(x) - std::abs(y);
+  if (z >= 0.0) return Vector(x, y, z).norm();
+  return Vector((1.0 - std::abs(y)) * (x >= 0.0 ? 1.0 : -1.0),
+                (1.0 - std::abs(x)) * (y >= 0.0 ? 1.0 : -1.0), z)
+      .norm();
+}
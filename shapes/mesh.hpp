@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <optional>
+#include <vector>
+
+#include "math/vector.hpp"
+#include "shape.hpp"
+
+// Indexed triangle mesh: all triangles share one vertex buffer
+// Triangles are referenced individually by the BVH through their index
+class TriangleMesh {
+ public:
+  std::vector<Vector> positions;  // Vertex positions
+  std::vector<Vector> normals;    // Per-vertex normals (empty if flat shaded)
+  std::vector<uint32_t> indices;  // Three vertex indices per triangle
+  size_t materialIndex;
+
+  TriangleMesh(std::vector<Vector> pos, std::vector<Vector> norms,
+               std::vector<uint32_t> idx, const size_t matIndex);
+
+  size_t triangleCount() const { return indices.size() / 3; }
+  Bounds triangleBounds(size_t tri) const;
+  bool intersect(size_t tri, const Ray& ray, double& t, double& u,
+                 double& v) const;
+  HitInfo hitInfo(size_t tri, const Ray& ray, double t, double u,
+                  double v) const;
+  std::optional<HitInfo> intersects(size_t tri, const Ray& ray) const;
+
+  // Copy reduced to about targetTriangles by quadric error edge collapse
+  TriangleMesh simplified(size_t targetTriangles) const;
+  // Mean length of the triangle edges (0 if empty)
+  double meanEdgeLength() const;
+
+ private:
+  Vector normalAt(size_t tri, double u, double v) const;
+};
+
+// Triangle mesh stored in about a fifth of the memory, for very large meshes
+// Vertices are sorted along a Morton curve and split into clusters of
+// CLUSTER_SIZE, and each position is stored as three 16-bit offsets within
+// its cluster's box. Normals are octahedrally encoded in 32 bits. Vertices are
+// decoded on the fly by the intersection and shading code, and shared ones
+// decode identically for every triangle, so no cracks open between them.
+class CompressedMesh {
+ public:
+  static constexpr size_t CLUSTER_SIZE = 256;
+
+  // Box of a run of CLUSTER_SIZE vertices
+  struct Cluster {
+    Vector min;
+    Vector step;  // Size of one quantization step on each axis
+  };
+
+  std::vector<Cluster> clusters;
+  std::vector<uint16_t> positions;  // Three offsets per vertex
+  std::vector<uint32_t> normals;    // One per vertex (empty if flat shaded)
+  std::vector<uint32_t> indices;    // Three vertex indices per triangle
+  size_t materialIndex;
+
+  explicit CompressedMesh(const TriangleMesh& mesh);
+
+  size_t triangleCount() const { return indices.size() / 3; }
+  Vector position(uint32_t vertex) const;
+  Bounds triangleBounds(size_t tri) const;
+  bool intersect(size_t tri, const Ray& ray, double& t, double& u,
+                 double& v) const;
+  HitInfo hitInfo(size_t tri, const Ray& ray, double t, double u,
+                  double v) const;
+  std::optional<HitInfo> intersects(size_t tri, const Ray& ray) const;
+
+ private:
+  Vector normalAt(size_t tri, double u, double v) const;
+};
+
+// Unit vector folded onto an octahedron and stored as two 16-bit coordinates
+// Zero vectors encode to NO_NORMAL.
+constexpr uint32_t NO_NORMAL = UINT32_MAX;
+uint32_t encodeOctahedral(const Vector& n);
+Vector decodeOctahedral(uint32_t code);
@@ -3,7 +3,6 @@
 #include <stdlib.h>
 
 #include <cmath>
-#include <optional>
 
 #include "math/ray.hpp"
 #include "math/vector.hpp"
@@ -14,20 +13,27 @@ Plane::Plane(const Vector& pt, const Vector& norm, const size_t matIndex)
     : Shape(matIndex), point(pt), normal(norm) {}
 
 // Calculate intersection of ray with plane
-std::optional<HitInfo> Plane::intersects(const Ray& ray) const {
+bool Plane::intersect(const Ray& ray, double& t, double& u, double& v) const {
   double denom = normal.dot(ray.dir);
 
   // Ray is essentially parallel to the plane, no intersection
   if (std::abs(denom) < Vector::EPS) {
-    return std::nullopt;
+    return false;
   }
 
-  double t = (point - ray.orig).dot(normal) / denom;
+  t = (point - ray.orig).dot(normal) / denom;
   // Negative t, no intersection
   if (t < Vector::EPS) {
-    return std::nullopt;
+    return false;
   }
 
+  u = 0.0;
+  v = 0.0;
+  return true;
+}
+
+// Calculate intersection details
+HitInfo Plane::hitInfo(const Ray& ray, double t, double, double) const {
   Vector hitPoint = ray.at(t);
   return HitInfo(hitPoint, normal, ray, t, materialIndex);
 }
\ No newline at end of file
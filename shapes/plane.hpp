@@ -6,14 +6,17 @@
 #include "shape.hpp"
 
 // Represents an infinite plane
-class Plane : public Shape {
+class Plane final : public Shape {
  public:
   Vector point;   // a point on plane
   Vector normal;  // normalized normal vector
 
   Plane(const Vector& p, const Vector& n, const size_t matIndex);
 
-  std::optional<HitInfo> intersects(const Ray& ray) const override;
+  bool intersect(const Ray& ray, double& t, double& u,
+                 double& v) const override;
+  HitInfo hitInfo(const Ray& ray, double t, double u,
+                  double v) const override;
   int getShapeType() const override { return Shape::PLANE; }
 
   Plane* clone() const override { return new Plane(*this); }
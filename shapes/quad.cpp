@@ -0,0 +1,138 @@
+#include "quad.hpp"
+
+#include <cmath>
+#include <optional>
+#include <utility>
+
+#include "math/ray.hpp"
+#include "math/vector.hpp"
+
+QuadMesh::QuadMesh(std::vector<Vector> pos, std::vector<Vector> norms,
+                   std::vector<uint32_t> idx, const size_t matIndex)
+    : positions(std::move(pos)),
+      normals(std::move(norms)),
+      indices(std::move(idx)),
+      materialIndex(matIndex) {}
+
+// Bounding box of a single quad (a bilinear patch lies within its corners)
+Bounds QuadMesh::quadBounds(size_t quad) const {
+  const Vector& a = positions[indices[4 * quad]];
+  const Vector& b = positions[indices[4 * quad + 1]];
+  const Vector& c = positions[indices[4 * quad + 2]];
+  const Vector& d = positions[indices[4 * quad + 3]];
+  return Bounds(a.min(b).min(c).min(d), a.max(b).max(c).max(d));
+}
+
+// Calculate intersection of ray with one quad of the mesh
+bool QuadMesh::intersect(size_t quad, const Ray& ray, double& t, double& u,
+                         double& v) const {
+  return intersectQuad(ray, positions[indices[4 * quad]],
+                       positions[indices[4 * quad + 1]],
+                       positions[indices[4 * quad + 2]],
+                       positions[indices[4 * quad + 3]], t, u, v);
+}
+
+// Calculate intersection details of a hit found by intersect
+HitInfo QuadMesh::hitInfo(size_t quad, const Ray& ray, double t, double u,
+                          double v) const {
+  return HitInfo{ray.at(t), normalAt(quad, u, v), ray, t, materialIndex};
+}
+
+// Intersect and resolve the hit details in one step
+std::optional<HitInfo> QuadMesh::intersects(size_t quad,
+                                            const Ray& ray) const {
+  double t, u, v;
+  if (!intersect(quad, ray, t, u, v)) return std::nullopt;
+  return hitInfo(quad, ray, t, u, v);
+}
+
+// Interpolated vertex normal, or patch normal if any vertex lacks a normal
+// The patch normal faces the same way as the first triangle of a fan split
+Vector QuadMesh::normalAt(size_t quad, double u, double v) const {
+  const uint32_t i00 = indices[4 * quad];
+  const uint32_t i10 = indices[4 * quad + 1];
+  const uint32_t i11 = indices[4 * quad + 2];
+  const uint32_t i01 = indices[4 * quad + 3];
+
+  const Vector zero;
+  if (normals.empty() || normals[i00] == zero || normals[i10] == zero ||
+      normals[i11] == zero || normals[i01] == zero) {
+    const Vector& q00 = positions[i00];
+    const Vector& q10 = positions[i10];
+    const Vector& q11 = positions[i11];
+    const Vector& q01 = positions[i01];
+    const Vector du = (q10 - q00) * (1 - v) + (q11 - q01) * v;
+    const Vector dv = (q01 - q00) * (1 - u) + (q11 - q10) * u;
+    return du.cross(dv).norm();
+  }
+  return (normals[i00] * ((1 - u) * (1 - v)) + normals[i10] * (u * (1 - v)) +
+          normals[i11] * (u * v) + normals[i01] * ((1 - u) * v))
+      .norm();
+}
+
+// Point on the patch edge at u whose distance from the ray is solved for v
+// Sets t and v and returns true if the ray meets the patch there
+static bool solveQuadV(const Ray& ray, const Vector& q00, const Vector& q10,
+                       const Vector& e00, const Vector& e11, double u,
+                       double& t, double& v) {
+  if (u < 0.0 || u > 1.0) return false;
+  const Vector pa = q00 + (q10 - q00) * u;
+  const Vector pb = e00 + (e11 - e00) * u;
+  Vector n = ray.dir.cross(pb);
+  const double det = n * n;
+  if (det < Vector::EPS * Vector::EPS) return false;
+  n = n.cross(pa);
+  const double vDet = n * ray.dir;
+  if (vDet < 0.0 || vDet > det) return false;
+  t = (n * pb) / det;
+  v = vDet / det;
+  return true;
+}
+
+// Reshetov's ray/bilinear patch test (Ray Tracing Gems, chapter 8)
+// Points on the patch lie on the segment from q00 + u(q10 - q00) to
+// q01 + u(q11 - q01); requiring the ray to meet that segment gives a
+// quadratic in u, and each root in [0, 1] is solved for v and t. Corners are
+// taken relative to the ray origin to keep the products small.
+bool intersectQuad(const Ray& ray, const Vector& q00, const Vector& q10,
+                   const Vector& q11, const Vector& q01, double& t, double& u,
+                   double& v) {
+  const Vector e00 = q01 - q00;
+  const Vector e11 = q11 - q10;
+  const Vector qn = (q10 - q00).cross(q01 - q11);
+  const Vector p00 = q00 - ray.orig;
+  const Vector p10 = q10 - ray.orig;
+
+  // Coefficients of a + b u + c u^2 = 0
+  const double a = p00.cross(ray.dir) * e00;
+  const double c = qn * ray.dir;
+  const double b = p10.cross(ray.dir) * e11 - a - c;
+
+  double disc = b * b - 4.0 * a * c;
+  if (disc < 0.0) return false;
+  disc = std::sqrt(disc);
+
+  // Roots in the numerically stable order (u2 < 0 if there is only one)
+  double u1, u2 = -1.0;
+  if (c == 0.0) {
+    if (b == 0.0) return false;  // Ray runs parallel to the patch
+    u1 = -a / b;
+  } else {
+    const double q = -0.5 * (b + std::copysign(disc, b));
+    u1 = q / c;
+    if (q != 0.0) u2 = a / q;
+  }
+
+  bool found = false;
+  double rootT, rootV;
+  for (const double root : {u1, u2}) {
+    if (solveQuadV(ray, p00, p10, e00, e11, root, rootT, rootV) &&
+        rootT >= Vector::EPS && (!found || rootT < t)) {
+      t = rootT;
+      u = root;
+      v = rootV;
+      found = true;
+    }
+  }
+  return found;
+}
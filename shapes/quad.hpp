@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <optional>
+#include <vector>
+
+#include "math/vector.hpp"
+#include "shape.hpp"
+
+// Indexed mesh of quads: all quads share one vertex buffer
+// Each quad is the bilinear patch through its four corners, in order around
+// its border, so planar quads are exactly flat and warped ones stay smooth
+// and crack-free along shared edges. Quads are referenced individually by the
+// BVH through their index, like the triangles of a TriangleMesh.
+class QuadMesh {
+ public:
+  std::vector<Vector> positions;  // Vertex positions
+  std::vector<Vector> normals;    // Per-vertex normals (empty if flat shaded)
+  std::vector<uint32_t> indices;  // Four vertex indices per quad
+  size_t materialIndex;
+
+  QuadMesh(std::vector<Vector> pos, std::vector<Vector> norms,
+           std::vector<uint32_t> idx, const size_t matIndex);
+
+  size_t quadCount() const { return indices.size() / 4; }
+  Bounds quadBounds(size_t quad) const;
+  bool intersect(size_t quad, const Ray& ray, double& t, double& u,
+                 double& v) const;
+  HitInfo hitInfo(size_t quad, const Ray& ray, double t, double u,
+                  double v) const;
+  std::optional<HitInfo> intersects(size_t quad, const Ray& ray) const;
+
+ private:
+  Vector normalAt(size_t quad, double u, double v) const;
+};
+
+// Ray test against the bilinear patch with corners q00, q10, q11, q01
+// On hit, sets t to the nearest distance beyond EPS and (u, v) to the patch
+// coordinates, with u running from q00 to q10 and v from q00 to q01
+bool intersectQuad(const Ray& ray, const Vector& q00, const Vector& q10,
+                   const Vector& q11, const Vector& q01, double& t, double& u,
+                   double& v);
@@ -0,0 +1,77 @@
+#include "sdf.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "math/ray.hpp"
+#include "shapes/shape.hpp"
+
+DistanceField::DistanceField(DistanceFunction dist, const Vector& bmin,
+                             const Vector& bmax, double lip, int steps,
+                             double tol, const size_t matIndex)
+    : BoundedShape(matIndex),
+      distance(std::move(dist)),
+      boxMin(bmin),
+      boxMax(bmax),
+      lipschitz(lip),
+      maxSteps(steps),
+      tolerance(tol) {}
+
+// Sphere trace the ray across the box
+// A ray that starts within tolerance of the surface, like a shadow or
+// reflection ray leaving it, first steps out of that band so it does not
+// hit the point it left
+bool DistanceField::intersect(const Ray& ray, double& t, double& u,
+                              double& v) const {
+  u = 0.0;
+  v = 0.0;
+  double tmin, tmax;
+  if (!bounds().intersects(ray, tmin, tmax)) return false;
+
+  // Distances are along the ray, so steps are scaled by its length
+  const double stepScale = 1.0 / (lipschitz * ray.dir.mag());
+  bool leaving = tmin <= 0.0;  // Ray starts inside the box
+  t = std::max(tmin, Vector::EPS);
+  for (int step = 0; step < maxSteps && t <= tmax; ++step) {
+    const double d = std::abs(distance(ray.at(t)));
+    if (d >= tolerance) {
+      leaving = false;
+      t += d * stepScale;
+    } else if (!leaving) {
+      return true;
+    } else {
+      t += tolerance * stepScale;
+    }
+  }
+  return false;
+}
+
+// Normal is the gradient of the distance, from four samples at the corners
+// of a tetrahedron around the hit point
+HitInfo DistanceField::hitInfo(const Ray& ray, double t, double,
+                               double) const {
+  const Vector pos = ray.at(t);
+  const double h = tolerance;
+  const Vector a(1, -1, -1), b(-1, -1, 1), c(-1, 1, -1), d(1, 1, 1);
+  const Vector gradient =
+      a * distance(pos + a * h) + b * distance(pos + b * h) +
+      c * distance(pos + c * h) + d * distance(pos + d * h);
+  return HitInfo(pos, gradient.norm(), ray, t, materialIndex);
+}
+
+double roundBoxDistance(const Vector& p, const Vector& halfExtents,
+                        double radius) {
+  const Vector q(std::abs(p.x()) - halfExtents.x() + radius,
+                 std::abs(p.y()) - halfExtents.y() + radius,
+                 std::abs(p.z()) - halfExtents.z() + radius);
+  const double inside = std::min(std::max({q.x(), q.y(), q.z()}), 0.0);
+  return q.max(Vector(0, 0, 0)).mag() + inside - radius;
+}
+
+// Polynomial smooth minimum (Quilez)
+double smoothMin(double a, double b, double k) {
+  if (k <= 0.0) return std::min(a, b);
+  const double h = std::max(k - std::abs(a - b), 0.0) / k;
+  return std::min(a, b) - h * h * k * 0.25;
+}
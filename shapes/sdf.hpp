@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <functional>
+
+#include "math/vector.hpp"
+#include "shape.hpp"
+
+// Signed distance from a point to a surface (negative inside)
+using DistanceFunction = std::function<double(const Vector&)>;
+
+// Surface given implicitly by a signed distance function within a box
+// Rays are sphere traced: each step advances by the distance to the surface
+// divided by the function's Lipschitz bound (the most it changes per unit of
+// distance, 1 for an exact distance), which can never step through it. Only
+// the part of the ray inside the box is marched.
+class DistanceField final : public BoundedShape {
+ public:
+  const DistanceFunction distance;
+  const Vector boxMin;     // Box the surface lies within
+  const Vector boxMax;
+  const double lipschitz;  // Bound on |distance(a) - distance(b)| / |a - b|
+  const int maxSteps;      // Steps before a ray is taken to miss
+  const double tolerance;  // Distance at which a point counts as on surface
+
+  DistanceField(DistanceFunction dist, const Vector& bmin, const Vector& bmax,
+                double lip, int steps, double tol, const size_t matIndex);
+
+  bool intersect(const Ray& ray, double& t, double& u,
+                 double& v) const override;
+  HitInfo hitInfo(const Ray& ray, double t, double u,
+                  double v) const override;
+  Bounds bounds() const override { return Bounds(boxMin, boxMax); }
+  int getShapeType() const override { return Shape::DISTANCE_FIELD; }
+
+  DistanceField* clone() const override { return new DistanceField(*this); }
+};
+
+// Exact distance to a box of the given half extents centered on the origin,
+// with its edges rounded off by radius
+double roundBoxDistance(const Vector& p, const Vector& halfExtents,
+                        double radius);
+// Minimum of a and b blended over distance k, to fuse two shapes smoothly
+// Keeps the Lipschitz bound of its inputs
+double smoothMin(double a, double b, double k);
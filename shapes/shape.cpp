@@ -1,12 +1,23 @@
 #include "shape.hpp"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
 #include <utility>
 
 #include "math/vector.hpp"
 
+// Intersect and resolve the hit details in one step
+std::optional<HitInfo> Shape::intersects(const Ray& ray) const {
+  double t, u, v;
+  if (!intersect(ray, t, u, v)) return std::nullopt;
+  return hitInfo(ray, t, u, v);
+}
+
 // Expand bounds to include another bounds
-void Bounds::expand(const Bounds& other) {
+template <typename T>
+void BoundsT<T>::expand(const BoundsT& other) {
   min = min.min(other.min);
   max = max.max(other.max);
   compCenter();
@@ -14,7 +25,8 @@ void Bounds::expand(const Bounds& other) {
 }
 
 // Expand bounds to include a point
-void Bounds::expand(const Vector& point) {
+template <typename T>
+void BoundsT<T>::expand(const VectorT<T>& point) {
   min = min.min(point);
   max = max.max(point);
   compCenter();
@@ -22,26 +34,33 @@ void Bounds::expand(const Vector& point) {
 }
 
 // Calculate surface area of the bounds
-void Bounds::compArea() {
-  Vector diff = max - min;
-  area =
-      2.0 * (diff.x() * diff.y() + diff.y() * diff.z() + diff.z() * diff.x());
+template <typename T>
+void BoundsT<T>::compArea() {
+  VectorT<T> diff = max - min;
+  area = 2 * (diff.x() * diff.y() + diff.y() * diff.z() + diff.z() * diff.x());
 }
 
 // Calculate center point of the bounds
-void Bounds::compCenter() { center = (min + max) * 0.5; }
+template <typename T>
+void BoundsT<T>::compCenter() { center = (min + max) * 0.5; }
 
 // Ray-box intersection test (updates tmin and tmax)
-bool Bounds::intersects(const Ray& ray, double& tmin, double& tmax) const {
-  tmin = 0.0;
-  tmax = std::numeric_limits<double>::max();
+template <typename T>
+bool BoundsT<T>::intersects(const RayT<T>& ray, T& tmin, T& tmax) const {
+  tmin = 0;
+  tmax = std::numeric_limits<T>::max();
 
+  // Direction components are kept away from zero so the slabs never divide
+  // by it: fast math assumes no infinities and gets the test wrong with them
+  constexpr T TINY = std::numeric_limits<T>::epsilon() *
+                     std::numeric_limits<T>::epsilon();
   for (int i = 0; i < 3; ++i) {
-    double invD = 1.0 / ray.dir[i];
-    double t0 = (min[i] - ray.orig[i]) * invD;
-    double t1 = (max[i] - ray.orig[i]) * invD;
+    const T d = ray.dir[i];
+    T invD = 1 / (std::abs(d) > TINY ? d : std::copysign(TINY, d));
+    T t0 = (min[i] - ray.orig[i]) * invD;
+    T t1 = (max[i] - ray.orig[i]) * invD;
 
-    if (invD < 0.0) std::swap(t0, t1);
+    if (invD < 0) std::swap(t0, t1);
 
     tmin = std::max(t0, tmin);
     tmax = std::min(t1, tmax);
@@ -50,3 +69,7 @@ bool Bounds::intersects(const Ray& ray, double& tmin, double& tmax) const {
   }
   return true;
 }
+
+// Precisions used by the renderer
+template struct BoundsT<float>;
+template struct BoundsT<double>;
@@ -2,6 +2,7 @@
 
 #include <stddef.h>
 
+#include <cmath>
 #include <limits>
 #include <optional>
 
@@ -34,14 +35,23 @@ class Shape {
   static constexpr int SPHERE = 1;
   static constexpr int PLANE = 2;
   static constexpr int CYLINDER = 3;
+  static constexpr int DISTANCE_FIELD = 4;
 
  public:
   const size_t materialIndex;
 
   Shape(const size_t matIndex) : materialIndex(matIndex) {}
 
+  // Returns true and sets distance t and surface coordinates u, v if the ray
+  // hits. Coordinates are only meaningful to the shape's hitInfo.
+  virtual bool intersect(const Ray& ray, double& t, double& u,
+                         double& v) const = 0;
+  // Position, normal and material of a hit found by intersect
+  virtual HitInfo hitInfo(const Ray& ray, double t, double u,
+                          double v) const = 0;
+
   // Returns HitInfo if intersection, std::nullopt otherwise
-  virtual std::optional<HitInfo> intersects(const Ray& ray) const = 0;
+  std::optional<HitInfo> intersects(const Ray& ray) const;
   virtual int getShapeType() const = 0;  // 0 = triangle, 1 = sphere, 2 = plane
   virtual Shape* clone() const = 0;
 
@@ -50,42 +60,73 @@ class Shape {
   friend class Converter;
 };
 
-struct Bounds {
+// Axis-aligned bounding box, templated on scalar type
+template <typename T>
+struct BoundsT {
  private:
   void compCenter();
   void compArea();
 
+  // Convert value to T, rounding toward +inf (up) or -inf (down)
+  template <typename U>
+  static T roundOutward(U value, bool up) {
+    T rounded = static_cast<T>(value);
+    const U back = static_cast<U>(rounded);
+    if (up ? back < value : back > value) {
+      rounded = std::nextafter(rounded, up ? std::numeric_limits<T>::max()
+                                           : std::numeric_limits<T>::lowest());
+    }
+    return rounded;
+  }
+  template <typename U>
+  static VectorT<T> roundOutward(const VectorT<U>& v, bool up) {
+    return VectorT<T>(roundOutward(v.x(), up), roundOutward(v.y(), up),
+                      roundOutward(v.z(), up));
+  }
+
  public:
-  Vector min;
-  Vector max;
-  Vector center;
-  double area;
-
-  Bounds()
-      : min(std::numeric_limits<double>::max()),
-        max(-std::numeric_limits<double>::max()),
+  VectorT<T> min;
+  VectorT<T> max;
+  VectorT<T> center;
+  T area;
+
+  BoundsT()
+      : min(std::numeric_limits<T>::max()),
+        max(-std::numeric_limits<T>::max()),
         center(),
         area(0) {}
-  Bounds(const Vector& point)
+  BoundsT(const VectorT<T>& point)
       : min(point), max(point), center(point), area(0) {}
-  Bounds(const Vector& bmin, const Vector& bmax) : min(bmin), max(bmax) {
+  BoundsT(const VectorT<T>& bmin, const VectorT<T>& bmax)
+      : min(bmin), max(bmax) {
     compCenter();
     compArea();
   }
 
-  void expand(const Bounds& other);
-  void expand(const Vector& point);
-  bool intersects(const Ray& ray, double& tmin, double& tmax) const;
+  // Convert from another precision, rounding outward so the box never shrinks
+  template <typename U>
+  explicit BoundsT(const BoundsT<U>& other)
+      : BoundsT(roundOutward(other.min, false),
+                roundOutward(other.max, true)) {}
+
+  void expand(const BoundsT& other);
+  void expand(const VectorT<T>& point);
+  bool intersects(const RayT<T>& ray, T& tmin, T& tmax) const;
 
-  ~Bounds() = default;
+  ~BoundsT() = default;
 };
 
+using Bounds = BoundsT<double>;
+
+// Shape of finite extent, which the BVH can hold
+// Bounds are computed on demand rather than stored: only the BVH builder needs
+// them, and it copies them into a transient array it frees when done, so the
+// shape itself keeps just what its intersection test reads.
 class BoundedShape : public Shape {
  public:
-  Bounds bounds;
+  BoundedShape(const size_t matIndex) : Shape(matIndex) {}
 
-  BoundedShape(const Vector& bmin, const Vector& bmax, const size_t matIndex)
-      : Shape(matIndex), bounds(bmin, bmax) {}
+  virtual Bounds bounds() const = 0;
 
   virtual ~BoundedShape() = default;
 };
\ No newline at end of file
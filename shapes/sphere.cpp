@@ -1,20 +1,44 @@
 #include "sphere.hpp"
 
+#include <stdint.h>
+
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <optional>
+#include <utility>
 
+#include "math/morton.hpp"
 #include "math/ray.hpp"
 #include "math/vector.hpp"
 #include "shapes/shape.hpp"
 
-// Bounding box is center +/- radius in all directions
 Sphere::Sphere(const Vector& cen, double r, const size_t matIndex)
-    : BoundedShape(cen - Vector(r, r, r), cen + Vector(r, r, r), matIndex),
-      center(cen),
-      radius(r) {}
+    : BoundedShape(matIndex), center(cen), radius(r) {}
+
+// Bounding box is center +/- radius in all directions
+Bounds Sphere::bounds() const {
+  return Bounds(center - Vector(radius, radius, radius),
+                center + Vector(radius, radius, radius));
+}
 
-// Calculate intersection of ray with sphere
-std::optional<HitInfo> Sphere::intersects(const Ray& ray) const {
+// Calculate nearest intersection of ray with sphere
+bool Sphere::intersect(const Ray& ray, double& t, double& u, double& v) const {
+  u = 0.0;
+  v = 0.0;
+  return intersectSphere(ray, center, radius, t);
+}
+
+// Calculate intersection details
+HitInfo Sphere::hitInfo(const Ray& ray, double t, double, double) const {
+  const Vector pos = ray.at(t);
+  const Vector normal = (pos - center).norm();
+  return HitInfo(pos, normal, ray, t, materialIndex);
+}
+
+// Solve the ray-sphere quadratic for the nearest positive root
+bool intersectSphere(const Ray& ray, const Vector& center, double radius,
+                     double& t) {
   double a = ray.dir * ray.dir;
   double b = 2.0 * (ray.dir * (ray.orig - center));
   double c = (ray.orig - center) * (ray.orig - center) - radius * radius;
@@ -23,7 +47,7 @@ std::optional<HitInfo> Sphere::intersects(const Ray& ray) const {
 
   // Negative discriminant means no intersection
   if (discriminant < 0) {
-    return std::nullopt;
+    return false;
   }
 
   double sqrtDisc = sqrt(discriminant);
@@ -32,17 +56,164 @@ std::optional<HitInfo> Sphere::intersects(const Ray& ray) const {
 
   // Find the nearest positive intersection
   // We know that t1 <= t2, so check t1 first
-  double t = (t1 > Vector::EPS) ? t1 : ((t2 > Vector::EPS) ? t2 : -1);
+  t = (t1 > Vector::EPS) ? t1 : ((t2 > Vector::EPS) ? t2 : -1);
 
   // Both intersections are negative, no intersection
-  if (t < 0) {
-    return std::nullopt;
+  return t >= 0;
+}
+
+// All lanes start out unused
+SpherePack::SpherePack() { std::fill(rSq, rSq + WIDTH, Real(-1)); }
+
+// Store one sphere in the given lane
+void SpherePack::set(int lane, const Vector& center, double radius) {
+  cx[lane] = static_cast<Real>(center.x());
+  cy[lane] = static_cast<Real>(center.y());
+  cz[lane] = static_cast<Real>(center.z());
+  rSq[lane] = static_cast<Real>(radius * radius);
+}
+
+// Ray-sphere on every lane at once, then pick the nearest hit
+// The discriminant is measured from the point of the ray closest to the
+// center rather than from the origin, which avoids the cancellation of
+// |origin - center|^2 - r^2 for small spheres far away in single precision
+int SpherePack::intersect(const RayT<Real>& ray, double& t, double& u,
+                          double& v) const {
+  const Real ox = ray.orig.x(), oy = ray.orig.y(), oz = ray.orig.z();
+  const Real dx = ray.dir.x(), dy = ray.dir.y(), dz = ray.dir.z();
+  const Real invA = 1 / (dx * dx + dy * dy + dz * dz);
+  constexpr Real MISS = std::numeric_limits<Real>::max();
+  constexpr Real EPS = VectorT<Real>::EPS;
+
+  alignas(32) Real laneT[WIDTH];
+  for (int i = 0; i < WIDTH; ++i) {
+    const Real ocx = ox - cx[i];
+    const Real ocy = oy - cy[i];
+    const Real ocz = oz - cz[i];
+
+    // Distance along the ray to the point closest to the center
+    const Real mid = -(dx * ocx + dy * ocy + dz * ocz) * invA;
+    const Real fx = ocx + mid * dx;
+    const Real fy = ocy + mid * dy;
+    const Real fz = ocz + mid * dz;
+    const Real disc = rSq[i] - (fx * fx + fy * fy + fz * fz);
+    const Real halfChord = std::sqrt(std::max(disc, Real(0)) * invA);
+
+    const Real nearT = mid - halfChord;
+    const Real dist = nearT > EPS ? nearT : mid + halfChord;
+    const bool hit = (disc >= 0) & (dist > EPS);
+    laneT[i] = hit ? dist : MISS;
+  }
+
+  int nearest = -1;
+  Real nearestT = MISS;
+  for (int i = 0; i < WIDTH; ++i) {
+    if (laneT[i] < nearestT) {
+      nearestT = laneT[i];
+      nearest = i;
+    }
+  }
+  if (nearest >= 0) {
+    t = nearestT;
+    u = 0.0;
+    v = 0.0;
   }
+  return nearest;
+}
+
+// Sort spheres along a Morton curve, so each pack holds nearby spheres, and
+// store every group of WIDTH in one pack relative to the group's center
+SphereSet::SphereSet(const std::vector<Vector>& centers,
+                     const std::vector<double>& radii, const size_t matIndex)
+    : materialIndex(matIndex) {
+  Bounds extent;
+  for (const Vector& center : centers) extent.expand(center);
+  const Vector size = extent.max - extent.min;
+  auto normalized = [&](const Vector& p) {
+    const Vector d = p - extent.min;
+    return Vector(size.x() > 0 ? d.x() / size.x() : 0.0,
+                  size.y() > 0 ? d.y() / size.y() : 0.0,
+                  size.z() > 0 ? d.z() / size.z() : 0.0);
+  };
+  std::vector<std::pair<uint64_t, size_t>> order(centers.size());
+  for (size_t i = 0; i < centers.size(); ++i) {
+    order[i] = {mortonCode(normalized(centers[i])), i};
+  }
+  std::sort(order.begin(), order.end());
+
+  const size_t count = (order.size() + SpherePack::WIDTH - 1) /
+                       SpherePack::WIDTH;
+  packs.resize(count);
+  origins.resize(count);
+  for (size_t p = 0; p < count; ++p) {
+    const size_t first = p * SpherePack::WIDTH;
+    const size_t last = std::min(first + SpherePack::WIDTH, order.size());
+    Bounds b;
+    for (size_t i = first; i < last; ++i) {
+      const Vector& c = centers[order[i].second];
+      const double r = radii[order[i].second];
+      b.expand(Bounds(c - Vector(r, r, r), c + Vector(r, r, r)));
+    }
+    origins[p] = (b.min + b.max) * 0.5;
+    for (size_t i = first; i < last; ++i) {
+      packs[p].set(static_cast<int>(i - first),
+                   centers[order[i].second] - origins[p],
+                   radii[order[i].second]);
+    }
+  }
+}
+
+// Number of used lanes over all packs
+size_t SphereSet::sphereCount() const {
+  size_t count = 0;
+  for (const SpherePack& pack : packs) {
+    count += std::count_if(pack.rSq, pack.rSq + SpherePack::WIDTH,
+                           [](Real rSq) { return rSq >= 0; });
+  }
+  return count;
+}
+
+// Bounding box of the used lanes of one pack
+Bounds SphereSet::packBounds(size_t pack) const {
+  const SpherePack& p = packs[pack];
+  Bounds b;
+  for (int i = 0; i < SpherePack::WIDTH && p.rSq[i] >= 0; ++i) {
+    const Vector center = origins[pack] + Vector(p.cx[i], p.cy[i], p.cz[i]);
+    const double r = std::sqrt(static_cast<double>(p.rSq[i]));
+    b.expand(Bounds(center - Vector(r, r, r), center + Vector(r, r, r)));
+  }
+  return b;
+}
+
+// Calculate nearest intersection of ray with one pack of the set
+// The ray is moved to the pack's origin in double precision first, and the
+// lane hit is returned in u
+bool SphereSet::intersect(size_t pack, const Ray& ray, double& t, double& u,
+                          double& v) const {
+  const RayT<Real> local(VectorT<Real>(ray.orig - origins[pack]),
+                         VectorT<Real>(ray.dir));
+  const int lane = packs[pack].intersect(local, t, u, v);
+  if (lane < 0) return false;
+  u = lane;
+  return true;
+}
 
-  // Calculate intersection details
+// Calculate intersection details of a hit found by intersect
+HitInfo SphereSet::hitInfo(size_t pack, const Ray& ray, double t, double u,
+                           double) const {
+  const SpherePack& p = packs[pack];
+  const int lane = static_cast<int>(u);
+  const Vector center =
+      origins[pack] + Vector(p.cx[lane], p.cy[lane], p.cz[lane]);
   const Vector pos = ray.at(t);
   const Vector normal = (pos - center).norm();
+  return HitInfo(pos, normal, ray, t, materialIndex);
+}
 
-  const HitInfo hitInfo(pos, normal, ray, t, materialIndex);
-  return hitInfo;
-}
\ No newline at end of file
+// Intersect and resolve the hit details in one step
+std::optional<HitInfo> SphereSet::intersects(size_t pack,
+                                             const Ray& ray) const {
+  double t, u, v;
+  if (!intersect(pack, ray, t, u, v)) return std::nullopt;
+  return hitInfo(pack, ray, t, u, v);
+}
@@ -2,19 +2,77 @@
 
 #include <stddef.h>
 
+#include <optional>
+#include <vector>
+
+#include "math/real.hpp"
 #include "math/vector.hpp"
 #include "shape.hpp"
 
 // Represents a sphere in 3D space
-class Sphere : public BoundedShape {
+class Sphere final : public BoundedShape {
  public:
   const Vector center;
   const double radius;
 
   Sphere(const Vector& cen, double r, const size_t matIndex);
 
-  std::optional<HitInfo> intersects(const Ray& ray) const override;
+  bool intersect(const Ray& ray, double& t, double& u,
+                 double& v) const override;
+  HitInfo hitInfo(const Ray& ray, double t, double u,
+                  double v) const override;
+  Bounds bounds() const override;
   int getShapeType() const override { return Shape::SPHERE; }
 
   Sphere* clone() const override { return new Sphere(*this); }
-};
\ No newline at end of file
+};
+
+// Ray-sphere test shared by all sphere primitives
+// On hit, sets t to the nearest distance beyond EPS
+bool intersectSphere(const Ray& ray, const Vector& center, double radius,
+                     double& t);
+
+// Spheres stored as a structure of arrays, one AVX register wide
+// Like TrianglePack, a whole BVH leaf or sphere set pack is tested against one
+// ray in a single branch-free loop that the compiler vectorizes. Unused lanes
+// have a negative squared radius, which is never hit.
+struct SpherePack {
+  static constexpr int WIDTH = 32 / sizeof(Real);
+
+  alignas(32) Real cx[WIDTH] = {};
+  alignas(32) Real cy[WIDTH] = {};
+  alignas(32) Real cz[WIDTH] = {};
+  alignas(32) Real rSq[WIDTH];
+
+  SpherePack();
+
+  void set(int lane, const Vector& center, double radius);
+
+  // Returns nearest lane hit by ray (-1 if none) and sets its distance t
+  // Surface coordinates u, v are always 0 for spheres
+  int intersect(const RayT<Real>& ray, double& t, double& u, double& v) const;
+};
+
+// Many spheres sharing one material, for particle and molecule scenes
+// Spheres are sorted along a Morton curve and stored in SpherePacks, which
+// are the only copy of their geometry. Lanes hold offsets from the pack's
+// own center, so float geometry keeps its precision far from the world
+// origin. The BVH references whole packs, and hits report their lane in u.
+class SphereSet {
+ public:
+  std::vector<SpherePack> packs;
+  std::vector<Vector> origins;  // Center of each pack's bounds
+  size_t materialIndex;
+
+  SphereSet(const std::vector<Vector>& centers,
+            const std::vector<double>& radii, const size_t matIndex);
+
+  size_t packCount() const { return packs.size(); }
+  size_t sphereCount() const;
+  Bounds packBounds(size_t pack) const;
+  bool intersect(size_t pack, const Ray& ray, double& t, double& u,
+                 double& v) const;
+  HitInfo hitInfo(size_t pack, const Ray& ray, double t, double u,
+                  double v) const;
+  std::optional<HitInfo> intersects(size_t pack, const Ray& ray) const;
+};
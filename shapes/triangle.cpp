@@ -3,7 +3,8 @@
 #include <stdlib.h>
 
 #include <cmath>
-#include <optional>
+#include <limits>
+#include <utility>
 
 #include "math/ray.hpp"
 #include "shapes/shape.hpp"
@@ -11,10 +12,12 @@
 // Construct triangle and compute normal
 Triangle::Triangle(const Vector& a, const Vector& b, const Vector& c,
                    const size_t matIndex)
-    : BoundedShape(a.min(b).min(c), a.max(b).max(c), matIndex),
+    : BoundedShape(matIndex),
       v0(a),
       v1(b),
       v2(c),
+      e1(b - a),
+      e2(c - a),
       n0((b - a).cross(c - a).norm()),
       n1(n0),
       n2(n0) {}
@@ -23,47 +26,208 @@ Triangle::Triangle(const Vector& a, const Vector& b, const Vector& c,
 Triangle::Triangle(const Vector& a, const Vector& b, const Vector& c,
                    const Vector& nA, const Vector& nB, const Vector& nC,
                    const size_t matIndex)
-    : BoundedShape(a.min(b).min(c), a.max(b).max(c), matIndex),
+    : BoundedShape(matIndex),
       v0(a),
       v1(b),
       v2(c),
+      e1(b - a),
+      e2(c - a),
       n0(nA.norm()),
       n1(nB.norm()),
       n2(nC.norm()) {}
 
+Bounds Triangle::bounds() const {
+  return Bounds(v0.min(v1).min(v2), v0.max(v1).max(v2));
+}
+
 // Calculate intersection of ray with triangle using Möller–Trumbore
 // algorithm Using implementation from wikipedia
-std::optional<HitInfo> Triangle::intersects(const Ray& ray) const {
-  Vector edge1 = v1 - v0;
-  Vector edge2 = v2 - v0;
+bool intersectTriangle(const Ray& ray, const Vector& v0, const Vector& edge1,
+                       const Vector& edge2, double& t, double& u, double& v) {
   Vector rayCrossEdge2 = ray.dir.cross(edge2);
   double det = edge1 * rayCrossEdge2;
 
   if (std::abs(det) < Vector::EPS)
-    return std::nullopt;  // Ray is parallel to triangle plane
+    return false;  // Ray is parallel to triangle plane
 
   double invDet = 1.0 / det;
   Vector s = ray.orig - v0;
-  double u = (s * rayCrossEdge2) * invDet;
+  u = (s * rayCrossEdge2) * invDet;
 
   // Validate u parameter
-  if (u < Vector::EPS || u > 1.0 + Vector::EPS) return std::nullopt;
+  if (u < 0.0 || u > 1.0) return false;
 
   Vector sCrossEdge1 = s.cross(edge1);
-  double v = invDet * (ray.dir * sCrossEdge1);
+  v = invDet * (ray.dir * sCrossEdge1);
 
   // Validate v parameter
-  if (v < -Vector::EPS || v > 1.0 + Vector::EPS || u + v > 1.0 + Vector::EPS)
-    return std::nullopt;
+  if (v < 0.0 || u + v > 1.0) return false;
+
+  t = invDet * (edge2 * sCrossEdge1);
+
+  return t >= Vector::EPS;  // Intersection behind ray origin
+}
+
+// 2D cross product p x q, rounded the same way for either operand order
+// Operands are put in a canonical order so the shared edge of two triangles
+// gives exactly negated results. With FMA hardware the fused multiply-subtract
+// is spelled out, since -ffast-math may otherwise fuse either product.
+static double edgeFunction(double px, double py, double qx, double qy) {
+  const bool swapped = qx < px || (qx == px && qy < py);
+  if (swapped) {
+    std::swap(px, qx);
+    std::swap(py, qy);
+  }
+#ifdef __FMA__
+  const double e = std::fma(px, qy, -(py * qx));
+#else
+  const double e = px * qy - py * qx;
+#endif
+  return swapped ? -e : e;
+}
+
+// Watertight ray-triangle intersection (Woop, Benthin and Wald 2013)
+// Vertices are moved into a ray space where the ray is the +z axis through
+// the origin, so edge tests of two triangles sharing an edge evaluate the
+// exact same expression and no ray can pass between them
+bool intersectTriangleWatertight(const Ray& ray, const Vector& v0,
+                                 const Vector& v1, const Vector& v2, double& t,
+                                 double& u, double& v) {
+  // Pick the dominant ray direction axis as z, keeping winding consistent
+  const Vector& d = ray.dir;
+  int kz = 0;
+  if (std::abs(d.y()) > std::abs(d[kz])) kz = 1;
+  if (std::abs(d.z()) > std::abs(d[kz])) kz = 2;
+  int kx = (kz + 1) % 3;
+  int ky = (kx + 1) % 3;
+  if (d[kz] < 0.0) std::swap(kx, ky);
+
+  // Shear constants mapping the ray direction onto the z axis
+  const double sx = d[kx] / d[kz];
+  const double sy = d[ky] / d[kz];
+  const double sz = 1.0 / d[kz];
+
+  // Vertices relative to ray origin, sheared into ray space
+  const Vector a = v0 - ray.orig;
+  const Vector b = v1 - ray.orig;
+  const Vector c = v2 - ray.orig;
+  const double ax = a[kx] - sx * a[kz];
+  const double ay = a[ky] - sy * a[kz];
+  const double bx = b[kx] - sx * b[kz];
+  const double by = b[ky] - sy * b[kz];
+  const double cx = c[kx] - sx * c[kz];
+  const double cy = c[ky] - sy * c[kz];
+
+  // Scaled barycentric coordinates from 2D edge functions
+  const double e0 = edgeFunction(cx, cy, bx, by);
+  const double e1 = edgeFunction(ax, ay, cx, cy);
+  const double e2 = edgeFunction(bx, by, ax, ay);
+  if ((e0 < 0.0 || e1 < 0.0 || e2 < 0.0) &&
+      (e0 > 0.0 || e1 > 0.0 || e2 > 0.0))
+    return false;  // Ray passes outside one of the edges
+
+  const double det = e0 + e1 + e2;
+  if (det == 0.0) return false;  // Ray is parallel to triangle plane
 
-  double t = invDet * (edge2 * sCrossEdge1);
+  // Hit distance from the edge-weighted vertex depths
+  const double tScaled = e0 * sz * a[kz] + e1 * sz * b[kz] + e2 * sz * c[kz];
+  const double invDet = 1.0 / det;
+  t = tScaled * invDet;
+  if (t < Vector::EPS) return false;  // Intersection behind ray origin
 
-  if (t < Vector::EPS) return std::nullopt;  // Intersection behind ray origin
+  u = e1 * invDet;
+  v = e2 * invDet;
+  return true;
+}
 
+// Calculate intersection of ray with triangle
+bool Triangle::intersect(const Ray& ray, double& t, double& u,
+                         double& v) const {
+#ifdef WATERTIGHT_TRIANGLES
+  return intersectTriangleWatertight(ray, v0, v1, v2, t, u, v);
+#else
+  return intersectTriangle(ray, v0, e1, e2, t, u, v);
+#endif
+}
+
+// Calculate intersection details
+HitInfo Triangle::hitInfo(const Ray& ray, double t, double u, double v) const {
   // Calculate interpolated normal (barycentric interpolation)
   // If vertex normals are all equivalent, this is just that normal
   Vector normal = (n0 * (1 - u - v) + n1 * u + n2 * v).norm();
 
-  // Calculate intersection details
   return HitInfo{ray.at(t), normal, ray, t, materialIndex};
-}
\ No newline at end of file
+}
+
+// Store one triangle in the given lane
+void TrianglePack::set(int lane, const Vector& v0, const Vector& edge1,
+                       const Vector& edge2) {
+  v0x[lane] = static_cast<Real>(v0.x());
+  v0y[lane] = static_cast<Real>(v0.y());
+  v0z[lane] = static_cast<Real>(v0.z());
+  e1x[lane] = static_cast<Real>(edge1.x());
+  e1y[lane] = static_cast<Real>(edge1.y());
+  e1z[lane] = static_cast<Real>(edge1.z());
+  e2x[lane] = static_cast<Real>(edge2.x());
+  e2y[lane] = static_cast<Real>(edge2.y());
+  e2z[lane] = static_cast<Real>(edge2.z());
+  minDet[lane] = static_cast<Real>(VectorT<Real>::EPS * edge1.mag() *
+                                   edge2.mag());
+}
+
+// Möller–Trumbore on every lane at once, then pick the nearest hit
+// Lanes are evaluated without early exits so the loop vectorizes
+int TrianglePack::intersect(const RayT<Real>& ray, double& t, double& u,
+                            double& v) const {
+  const Real ox = ray.orig.x(), oy = ray.orig.y(), oz = ray.orig.z();
+  const Real dx = ray.dir.x(), dy = ray.dir.y(), dz = ray.dir.z();
+  const Real dLen = std::sqrt(dx * dx + dy * dy + dz * dz);
+  constexpr Real MISS = std::numeric_limits<Real>::max();
+  constexpr Real EPS = VectorT<Real>::EPS;
+
+  alignas(32) Real laneT[WIDTH];
+  alignas(32) Real laneU[WIDTH];
+  alignas(32) Real laneV[WIDTH];
+  for (int i = 0; i < WIDTH; ++i) {
+    // Ray direction cross edge 2
+    const Real px = dy * e2z[i] - dz * e2y[i];
+    const Real py = dz * e2x[i] - dx * e2z[i];
+    const Real pz = dx * e2y[i] - dy * e2x[i];
+    const Real det = e1x[i] * px + e1y[i] * py + e1z[i] * pz;
+    const bool parallel = std::abs(det) <= minDet[i] * dLen;
+    const Real invDet = 1 / (parallel ? 1 : det);
+
+    const Real sx = ox - v0x[i];
+    const Real sy = oy - v0y[i];
+    const Real sz = oz - v0z[i];
+    const Real baryU = (sx * px + sy * py + sz * pz) * invDet;
+
+    // Origin offset cross edge 1
+    const Real qx = sy * e1z[i] - sz * e1y[i];
+    const Real qy = sz * e1x[i] - sx * e1z[i];
+    const Real qz = sx * e1y[i] - sy * e1x[i];
+    const Real baryV = invDet * (dx * qx + dy * qy + dz * qz);
+    const Real dist = invDet * (e2x[i] * qx + e2y[i] * qy + e2z[i] * qz);
+
+    const bool hit = !parallel & (baryU >= 0) & (baryU <= 1) & (baryV >= 0) &
+                     (baryU + baryV <= 1) & (dist >= EPS);
+    laneT[i] = hit ? dist : MISS;
+    laneU[i] = baryU;
+    laneV[i] = baryV;
+  }
+
+  int nearest = -1;
+  Real nearestT = MISS;
+  for (int i = 0; i < WIDTH; ++i) {
+    if (laneT[i] < nearestT) {
+      nearestT = laneT[i];
+      nearest = i;
+    }
+  }
+  if (nearest >= 0) {
+    t = nearestT;
+    u = laneU[nearest];
+    v = laneV[nearest];
+  }
+  return nearest;
+}
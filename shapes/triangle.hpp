@@ -2,15 +2,18 @@
 
 #include <stddef.h>
 
+#include "math/real.hpp"
 #include "math/vector.hpp"
 #include "shape.hpp"
 
 // Represents a triangle in 3D space
-class Triangle : public BoundedShape {
+class Triangle final : public BoundedShape {
  public:
   const Vector v0;
   const Vector v1;
   const Vector v2;
+  const Vector e1;  // Precomputed edge v1 - v0
+  const Vector e2;  // Precomputed edge v2 - v0
   const Vector n0;
   const Vector n1;
   const Vector n2;
@@ -21,8 +24,52 @@ class Triangle : public BoundedShape {
            const Vector& normalA, const Vector& normalB, const Vector& normalC,
            const size_t matIndex);
 
-  std::optional<HitInfo> intersects(const Ray& ray) const override;
+  bool intersect(const Ray& ray, double& t, double& u,
+                 double& v) const override;
+  HitInfo hitInfo(const Ray& ray, double t, double u,
+                  double v) const override;
+  Bounds bounds() const override;
   int getShapeType() const override { return Shape::TRIANGLE; }
 
   Triangle* clone() const override { return new Triangle(*this); }
-};
\ No newline at end of file
+};
+
+// Ray-triangle tests shared by all triangle primitives
+// On hit, they set distance t and barycentric weights u, v of the 2nd/3rd
+// vertex. The default build uses Möller–Trumbore on precomputed edges; build
+// with WATERTIGHT=1 to use the watertight test, which never lets a ray slip
+// through the shared edge of two triangles at the cost of extra arithmetic.
+bool intersectTriangle(const Ray& ray, const Vector& v0, const Vector& edge1,
+                       const Vector& edge2, double& t, double& u, double& v);
+bool intersectTriangleWatertight(const Ray& ray, const Vector& v0,
+                                 const Vector& v1, const Vector& v2, double& t,
+                                 double& u, double& v);
+// Triangles stored as a structure of arrays, one AVX register wide
+// A whole BVH leaf of triangles is tested against one ray in a single
+// branch-free loop that the compiler vectorizes. Packs hold four triangles in
+// double precision or eight with float geometry. Unused lanes hold degenerate
+// triangles, which are never hit.
+struct TrianglePack {
+  static constexpr int WIDTH = 32 / sizeof(Real);
+
+  alignas(32) Real v0x[WIDTH] = {};
+  alignas(32) Real v0y[WIDTH] = {};
+  alignas(32) Real v0z[WIDTH] = {};
+  alignas(32) Real e1x[WIDTH] = {};
+  alignas(32) Real e1y[WIDTH] = {};
+  alignas(32) Real e1z[WIDTH] = {};
+  alignas(32) Real e2x[WIDTH] = {};
+  alignas(32) Real e2y[WIDTH] = {};
+  alignas(32) Real e2z[WIDTH] = {};
+  // Determinant below which a unit ray counts as parallel to the triangle:
+  // EPS radians, scaled by the edge lengths so tiny triangles still count
+  // (0 in empty lanes, which are always parallel)
+  alignas(32) Real minDet[WIDTH] = {};
+
+  void set(int lane, const Vector& v0, const Vector& edge1,
+           const Vector& edge2);
+
+  // Returns nearest lane hit by ray (-1 if none) and sets its distance t
+  // and barycentric weights u, v
+  int intersect(const RayT<Real>& ray, double& t, double& u, double& v) const;
+};
@@ -1,17 +1,43 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cctype>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "math/color.hpp"
+#include "math/morton.hpp"
+#include "math/random.hpp"
 #include "math/ray.hpp"
+#include "math/real.hpp"
+#include "math/transform.hpp"
 #include "math/vector.hpp"
+#include "renderer/pool.hpp"
+#include "renderer/sampler.hpp"
+#include "renderer/tracer.hpp"
+#include "scene/bvh.hpp"
+#include "scene/prototype.hpp"
+#include "scene/scene.hpp"
 #include "shapes/cylinder.hpp"
+#include "shapes/mesh.hpp"
 #include "shapes/plane.hpp"
+#include "shapes/quad.hpp"
+#include "shapes/sdf.hpp"
 #include "shapes/shape.hpp"
 #include "shapes/sphere.hpp"
 #include "shapes/triangle.hpp"
@@ -74,12 +100,178 @@ void test_vector() {
   assert(v11 == Vector(-1.0, 1.0, -1.0));
 }
 
+void test_bounds_precision() {
+  std::cout << "Testing Bounds precision conversion..." << std::endl;
+
+  // Converting to float rounds outward, never shrinking the box
+  const Bounds b(Vector(0.1, -0.3, 1e6 + 0.1), Vector(0.7, 0.2, 1e6 + 0.3));
+  const BoundsT<float> f(b);
+  assert(f.min.x() <= 0.1 && f.min.y() <= -0.3 && f.min.z() <= 1e6 + 0.1);
+  assert(f.max.x() >= 0.7 && f.max.y() >= 0.2 && f.max.z() >= 1e6 + 0.3);
+
+  // Float vectors support the same operations
+  const VectorT<float> v(1.0f, 2.0f, 2.0f);
+  assert(std::abs(v.mag() - 3.0f) < 1e-6f);
+  assert(VectorT<float>(2.0f * v) == VectorT<float>(2.0f, 4.0f, 4.0f));
+}
+
+// Whether two vectors agree to within a small tolerance
+static bool near(const Vector& a, const Vector& b, double tolerance = 1e-9) {
+  return (a - b).mag() < tolerance;
+}
+
+// Whether text is exactly one JSON value, per the grammar at json.org
+static bool isJSON(const std::string& text) {
+  size_t i = 0;
+  auto at = [&](char c) { return i < text.size() && text[i] == c; };
+  auto take = [&](char c) { return at(c) && ++i; };
+  auto skipSpace = [&]() {
+    while (i < text.size() && std::isspace(static_cast<uint8_t>(text[i]))) {
+      ++i;
+    }
+  };
+  auto digits = [&]() {
+    const size_t start = i;
+    while (i < text.size() && std::isdigit(static_cast<uint8_t>(text[i]))) {
+      ++i;
+    }
+    return i > start;
+  };
+  auto quoted = [&]() {
+    if (!take('"')) return false;
+    while (i < text.size() && text[i] != '"') {
+      if (static_cast<uint8_t>(text[i]) < 0x20) return false;
+      i += text[i] == '\\' ? 2 : 1;
+    }
+    return take('"');
+  };
+  std::function<bool()> value = [&]() {
+    skipSpace();
+    if (at('{') || at('[')) {
+      const bool object = at('{');
+      const char close = object ? '}' : ']';
+      ++i;
+      skipSpace();
+      if (take(close)) return true;
+      do {
+        if (object) {
+          skipSpace();
+          if (!quoted()) return false;
+          skipSpace();
+          if (!take(':')) return false;
+        }
+        if (!value()) return false;
+        skipSpace();
+      } while (take(','));
+      return take(close);
+    }
+    if (at('"')) return quoted();
+    for (const std::string word : {"true", "false", "null"}) {
+      if (text.compare(i, word.size(), word) == 0) {
+        i += word.size();
+        return true;
+      }
+    }
+
+    // Number: integer part without leading zeros, fraction and exponent
+    take('-');
+    if (!take('0') && !digits()) return false;
+    if (take('.') && !digits()) return false;
+    if (take('e') || take('E')) {
+      if (!take('+')) take('-');
+      if (!digits()) return false;
+    }
+    return true;
+  };
+  if (!value()) return false;
+  skipSpace();
+  return i == text.size();
+}
+
+// Every node is reached once from the root through in-range child indices,
+// children lie inside their parents and the leaves hold each primitive once
+static void checkBVH(const BVH& bvh) {
+  const std::vector<BVHNode>& nodes = bvh.getNodes();
+  const int n = static_cast<int>(nodes.size());
+  const int primCount = static_cast<int>(bvh.getPrims().size());
+  std::vector<int> reached(n, 0), held(primCount, 0);
+  std::vector<int> stack{0};
+  while (!stack.empty()) {
+    const BVHNode& node = nodes[stack.back()];
+    stack.pop_back();
+    if (node.shapeCount > 0) {
+      assert(node.left == -1 && node.right == -1);
+      assert(node.shapeIndex >= 0);
+      assert(node.shapeIndex + node.shapeCount <= primCount);
+      for (int i = 0; i < node.shapeCount; ++i) held[node.shapeIndex + i]++;
+      continue;
+    }
+    for (const int child : {node.left, node.right}) {
+      assert(child >= 0 && child < n);
+      assert(reached[child]++ == 0);
+      const BoundsT<Real>& inner = nodes[child].bounds;
+      const BoundsT<Real>& outer = node.bounds;
+      for (int axis = 0; axis < 3; ++axis) {
+        assert(inner.min[axis] >= outer.min[axis]);
+        assert(inner.max[axis] <= outer.max[axis]);
+      }
+      stack.push_back(child);
+    }
+  }
+  reached[0]++;
+  for (const int count : reached) assert(count == 1);
+  for (const int count : held) assert(count == 1);
+}
+
+void test_transform() {
+  std::cout << "Testing Transform..." << std::endl;
+
+  const Transform move = Transform::translate(Vector(1.0, 2.0, 3.0));
+  assert(near(move.point(Vector(1.0, 1.0, 1.0)), Vector(2.0, 3.0, 4.0)));
+  assert(near(move.vector(Vector(1.0, 1.0, 1.0)), Vector(1.0, 1.0, 1.0)));
+
+  // Quarter turn about z takes x to y
+  const Transform turn = Transform::rotate(Vector(0.0, 0.0, 2.0), 90.0);
+  assert(near(turn.point(Vector(1.0, 0.0, 0.0)), Vector(0.0, 1.0, 0.0)));
+
+  // Composition applies the right operand first
+  const Transform both = move * turn;
+  assert(near(both.point(Vector(1.0, 0.0, 0.0)), Vector(1.0, 3.0, 3.0)));
+  assert(near(both.inverse().point(Vector(1.0, 3.0, 3.0)),
+              Vector(1.0, 0.0, 0.0)));
+
+  // General matrices are inverted, and normals stay perpendicular
+  const Transform shear({{1.0, 0.5, 0.0, 1.0},
+                         {0.0, 2.0, 0.0, 0.0},
+                         {0.0, 0.0, 1.0, -1.0}});
+  const Vector p(0.3, -0.7, 2.0);
+  assert(near(shear.inverse().point(shear.point(p)), p));
+  const Vector tangent(1.0, -1.0, 0.0), normal(1.0, 1.0, 0.0);
+  assert(std::abs(shear.vector(tangent) * shear.normal(normal)) < 1e-9);
+
+  // Ray parameters are preserved in object space
+  const Transform stretch = Transform::scale(Vector(2.0, 2.0, 2.0));
+  const Ray ray(Vector(4.0, 0.0, 0.0), Vector(-2.0, 0.0, 0.0));
+  const Ray local = stretch.toObject(ray);
+  assert(near(stretch.point(local.at(0.75)), ray.at(0.75)));
+
+  bool threw = false;
+  try {
+    Transform::scale(Vector(1.0, 0.0, 1.0));
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
 void test_sphere_intersect() {
   std::cout << "Testing Sphere intersection..." << std::endl;
 
   Sphere sphere1(Vector(0.0, 0.0, 0.0), 1.0, 0);
   Sphere sphere2(Vector(2.0, 2.0, 2.0), 0.5, 0);
   Ray ray(Vector(0.0, 0.0, -5.0), Vector(0.0, 0.0, 1.0));
+  assert(sphere2.bounds().min == Vector(1.5, 1.5, 1.5));
+  assert(sphere2.bounds().max == Vector(2.5, 2.5, 2.5));
 
   std::optional<HitInfo> hitInfoOpt1 = sphere1.intersects(ray);
   assert(hitInfoOpt1.has_value());
@@ -92,6 +284,92 @@ void test_sphere_intersect() {
   assert(!hitInfoOpt2.has_value());
 }
 
+void test_sphere_set() {
+  std::cout << "Testing SphereSet intersection..." << std::endl;
+
+  SphereSet set({Vector(0.0, 0.0, 0.0), Vector(2.0, 2.0, 2.0)}, {1.0, 0.5},
+                0);
+  assert(set.sphereCount() == 2 && set.packCount() == 1);
+
+  const Bounds b = set.packBounds(0);
+  assert(b.min == Vector(-1.0, -1.0, -1.0) && b.max == Vector(2.5, 2.5, 2.5));
+
+  Ray ray(Vector(0.0, 0.0, -5.0), Vector(0.0, 0.0, 1.0));
+  auto hit = set.intersects(0, ray);
+  assert(hit.has_value());
+  assert(std::abs(hit->t - 4.0) < 1e-6);
+  assert(near(hit->normal, Vector(0.0, 0.0, -1.0), 1e-6));
+
+  Ray ray2(Vector(2.0, 2.0, -5.0), Vector(0.0, 0.0, 1.0));
+  auto hit2 = set.intersects(0, ray2);
+  assert(hit2.has_value() && std::abs(hit2->t - 6.5) < 1e-6);
+  assert(!set.intersects(0, Ray(Vector(5.0, 0.0, -5.0), ray.dir)));
+
+  // Spheres fill whole packs
+  std::vector<Vector> centers;
+  for (int i = 0; i < 20; ++i) centers.emplace_back(i, 0.0, 0.0);
+  SphereSet row(centers, std::vector<double>(20, 0.25), 0);
+  assert(row.sphereCount() == 20);
+  assert(row.packCount() ==
+         (20 + SpherePack::WIDTH - 1) / SpherePack::WIDTH);
+
+  // Lanes are relative to their pack, so spheres far from the world origin
+  // keep their shape even with float geometry
+  SphereSet far({Vector(1e6, 0.0, 0.0), Vector(1e6 + 0.01, 0.0, 0.0)},
+                {0.001, 0.001}, 0);
+  auto farHit =
+      far.intersects(0, Ray(Vector(1e6 + 0.01, 0.0, -1.0), ray.dir));
+  assert(farHit.has_value() && std::abs(farHit->t - 0.999) < 1e-5);
+  assert(!far.intersects(0, Ray(Vector(1e6 + 0.005, 0.0, -1.0), ray.dir)));
+
+  // Scene validates the set
+  Scene scene(1, 1, 1);
+  const Material mat{.color = Color(255, 255, 255), .reflectivity = 0};
+  bool threw = false;
+  try {
+    scene.addSphereSet({Vector(0.0, 0.0, 0.0)}, {1.0, 2.0}, mat);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+  scene.addSphereSet({Vector(0.0, 0.0, 0.0), Vector(3.0, 0.0, 0.0)},
+                     {1.0, 1.0}, mat);
+  assert(scene.sphereSetCount() == 1 && scene.setSphereCount() == 2);
+}
+
+void test_sphere_pack() {
+  std::cout << "Testing SpherePack intersection..." << std::endl;
+
+  // Two spheres along the ray in lanes 0 and 1, other lanes left empty
+  SpherePack pack;
+  pack.set(0, Vector(0.0, 0.0, 0.0), 1.0);
+  pack.set(1, Vector(0.0, 0.0, 3.0), 0.5);
+
+  // Nearest lane wins
+  double t, u, v;
+  RayT<Real> ray1(VectorT<Real>(0.0, 0.0, 10.0),
+                  VectorT<Real>(0.0, 0.0, -1.0));
+  assert(pack.intersect(ray1, t, u, v) == 1);
+  assert(std::abs(t - 6.5) < 1e-5);
+
+  // From inside a sphere its far side is hit
+  RayT<Real> ray2(VectorT<Real>(0.0, 0.0, 0.0), VectorT<Real>(0.0, 0.0, 2.0));
+  assert(pack.intersect(ray2, t, u, v) == 0);
+  assert(std::abs(t - 0.5) < 1e-5);
+
+  // Tiny sphere far from the ray origin is still hit
+  SpherePack far;
+  far.set(0, Vector(0.0, 0.0, 1000.0), 1e-3);
+  RayT<Real> ray3(VectorT<Real>(0.0, 0.0, 0.0), VectorT<Real>(0.0, 0.0, 1.0));
+  assert(far.intersect(ray3, t, u, v) == 0);
+  assert(std::abs(t - 1000.0) < 1e-2);
+
+  // Missing all spheres
+  RayT<Real> ray4(VectorT<Real>(2.0, 0.0, 10.0),
+                  VectorT<Real>(0.0, 0.0, -1.0));
+  assert(pack.intersect(ray4, t, u, v) == -1);
+}
+
 void test_plane_intersect() {
   std::cout << "Testing Plane intersection..." << std::endl;
 
@@ -141,6 +419,8 @@ void test_cylinder_intersect() {
   std::cout << "Testing Cylinder intersection..." << std::endl;
 
   Cylinder cyl(Vector(0.0, 0.0, 0.0), 1.0, 2.0, 0);
+  assert(cyl.bounds().min == Vector(-1.0, -1.0, -1.0));
+  assert(cyl.bounds().max == Vector(1.0, 1.0, 1.0));
 
   {
     Ray ray(Vector(2.0, 0.0, 0.0), Vector(-1.0, 0.0, 0.0));
@@ -186,13 +466,1141 @@ void test_cylinder_intersect() {
   std::cout << "Cylinder tests passed!" << std::endl;
 }
 
+void test_distance_field() {
+  std::cout << "Testing DistanceField intersection..." << std::endl;
+
+  // Unit sphere as an exact distance, and as one twice too large
+  auto sphere = [](const Vector& p) { return p.mag() - 1.0; };
+  const Vector bmin(-1.0, -1.0, -1.0), bmax(1.0, 1.0, 1.0);
+  DistanceField exact(sphere, bmin, bmax, 1.0, 256, 1e-6, 0);
+  DistanceField scaled([&](const Vector& p) { return 2.0 * sphere(p); },
+                       bmin, bmax, 2.0, 256, 1e-6, 0);
+
+  const Ray ray(Vector(0.0, 0.0, 5.0), Vector(0.0, 0.0, -2.0));
+  for (const DistanceField* field : {&exact, &scaled}) {
+    auto hit = field->intersects(ray);
+    assert(hit.has_value());
+    assert(std::abs(hit->t - 2.0) < 1e-5);
+    assert(near(hit->normal, Vector(0.0, 0.0, 1.0), 1e-4));
+  }
+  assert(!exact.intersects(Ray(Vector(2.0, 0.0, 5.0), ray.dir)).has_value());
+  assert(!exact.intersects(Ray(Vector(0.9, 0.9, 5.0), ray.dir)).has_value());
+
+  // Rays leaving the surface do not hit where they start
+  const Vector top(0.0, 0.0, 1.0);
+  assert(!exact.intersects(Ray(top, Vector(0.0, 1.0, 1.0))).has_value());
+  auto through = exact.intersects(Ray(top, Vector(0.0, 0.0, -1.0)));
+  assert(through.has_value() && std::abs(through->t - 2.0) < 1e-5);
+
+  // Rounded boxes blended together, traced through the BVH
+  Scene scene(1, 1, 1);
+  scene.addDistanceField(
+      [](const Vector& p) {
+        const Vector half(0.5, 0.5, 0.5);
+        return smoothMin(roundBoxDistance(p, half, 0.1),
+                         roundBoxDistance(p - Vector(1, 0, 0), half, 0.1),
+                         0.2);
+      },
+      Vector(-0.6, -0.6, -0.6), Vector(1.6, 0.6, 0.6), 1.0,
+      Material{.color = Color(255, 0, 0), .reflectivity = 0});
+  assert(scene.boundedShapeCount() == 1);
+  BVH bvh(scene);
+  Hit hit;
+  const Ray down(Vector(0.0, 0.0, 2.0), Vector(0.0, 0.0, -1.0));
+  assert(bvh.traverse(scene, down, hit));
+  assert(hit.prim.type == PrimRef::DISTANCE_FIELD);
+  assert(std::abs(hit.t - 1.5) < 1e-3);
+
+  bool threw = false;
+  try {
+    scene.addDistanceField(sphere, bmin, bmax, 0.0,
+                           Material{.color = Color(), .reflectivity = 0});
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void test_mesh_intersect() {
+  std::cout << "Testing TriangleMesh intersection..." << std::endl;
+
+  // Unit square in the xy-plane made of two triangles sharing an edge
+  TriangleMesh mesh({Vector(0.0, 0.0, 0.0), Vector(1.0, 0.0, 0.0),
+                     Vector(1.0, 1.0, 0.0), Vector(0.0, 1.0, 0.0)},
+                    {}, {0, 1, 2, 0, 2, 3}, 0);
+  assert(mesh.triangleCount() == 2);
+
+  const Bounds b = mesh.triangleBounds(1);
+  assert(b.min == Vector(0.0, 0.0, 0.0) && b.max == Vector(1.0, 1.0, 0.0));
+
+  Ray ray1(Vector(0.75, 0.25, 1.0), Vector(0.0, 0.0, -1.0));
+  auto hit1 = mesh.intersects(0, ray1);
+  assert(hit1.has_value());
+  assert(std::abs(hit1->t - 1.0) < 1e-6);
+  assert(hit1->pos == Vector(0.75, 0.25, 0.0));
+  assert(hit1->normal == Vector(0.0, 0.0, 1.0));
+  assert(!mesh.intersects(1, ray1).has_value());
+
+  Ray ray2(Vector(0.25, 0.75, 1.0), Vector(0.0, 0.0, -1.0));
+  assert(!mesh.intersects(0, ray2).has_value());
+  assert(mesh.intersects(1, ray2).has_value());
+
+  // Per-vertex normals are interpolated
+  TriangleMesh smooth({Vector(0.0, 0.0, 0.0), Vector(1.0, 0.0, 0.0),
+                       Vector(0.0, 1.0, 0.0)},
+                      {Vector(0.0, 0.0, 1.0), Vector(1.0, 0.0, 0.0),
+                       Vector(0.0, 0.0, 1.0)},
+                      {0, 1, 2}, 0);
+  Ray ray3(Vector(0.5, 0.25, 1.0), Vector(0.0, 0.0, -1.0));
+  auto hit3 = smooth.intersects(0, ray3);
+  assert(hit3.has_value());
+  assert(hit3->normal.x() > 0.0 && hit3->normal.z() > 0.0);
+}
+
+void test_quad_intersect() {
+  std::cout << "Testing QuadMesh intersection..." << std::endl;
+
+  // Unit square in the xy-plane as one planar quad
+  QuadMesh square({Vector(0.0, 0.0, 0.0), Vector(1.0, 0.0, 0.0),
+                   Vector(1.0, 1.0, 0.0), Vector(0.0, 1.0, 0.0)},
+                  {}, {0, 1, 2, 3}, 0);
+  assert(square.quadCount() == 1);
+  double t, u, v;
+  Ray ray1(Vector(0.25, 0.75, 1.0), Vector(0.0, 0.0, -1.0));
+  assert(square.intersect(0, ray1, t, u, v));
+  assert(std::abs(t - 1.0) < 1e-9);
+  assert(std::abs(u - 0.25) < 1e-9 && std::abs(v - 0.75) < 1e-9);
+  assert(near(square.hitInfo(0, ray1, t, u, v).normal, Vector(0, 0, 1)));
+  assert(!square.intersect(0, Ray(Vector(1.5, 0.5, 1.0), ray1.dir), t, u, v));
+  assert(!square.intersect(0, Ray(Vector(0.5, 0.5, -1.0), ray1.dir), t, u, v));
+
+  // Warped quad is the saddle z = xy, hit from above and from the side
+  const Vector q00(0.0, 0.0, 0.0), q10(1.0, 0.0, 0.0), q11(1.0, 1.0, 1.0),
+      q01(0.0, 1.0, 0.0);
+  assert(intersectQuad(Ray(Vector(0.5, 0.5, 5.0), ray1.dir), q00, q10, q11,
+                       q01, t, u, v));
+  assert(std::abs(t - 4.75) < 1e-9);
+  assert(intersectQuad(Ray(Vector(-1.0, 0.5, 0.1), Vector(1.0, 0.0, 0.0)),
+                       q00, q10, q11, q01, t, u, v));
+  assert(std::abs(t - 1.2) < 1e-9 && std::abs(v - 0.5) < 1e-9);
+
+  // Quads are traced through the BVH like any other primitive
+  Scene scene(1, 1, 1);
+  scene.addQuadMesh({Vector(0.0, 0.0, 0.0), Vector(1.0, 0.0, 0.0),
+                     Vector(1.0, 1.0, 0.0), Vector(0.0, 1.0, 0.0),
+                     Vector(2.0, 0.0, 0.0), Vector(2.0, 1.0, 0.0)},
+                    {}, {0, 1, 2, 3, 1, 4, 5, 2},
+                    Material{.color = Color(255, 0, 0), .reflectivity = 0});
+  assert(scene.meshQuadCount() == 2);
+  BVH bvh(scene);
+  Hit hit;
+  const Ray ray2(Vector(1.5, 0.5, 1.0), ray1.dir);
+  assert(bvh.traverse(scene, ray2, hit));
+  assert(hit.prim.type == PrimRef::MESH_QUAD && hit.prim.element == 1);
+  assert(near(scene.hitInfo(hit, ray2).pos, Vector(1.5, 0.5, 0.0)));
+
+  // OBJ quads are imported whole, other faces as triangles
+  const std::string path = "/tmp/supertracer_test_quads.obj";
+  std::ofstream obj(path);
+  obj << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 0\n"
+      << "f 1 2 3 4\nf 2 5 3\n";
+  obj.close();
+  Scene imported(1, 1, 1);
+  assert(imported.importOBJ(Vector(), path, 1.0,
+                            Material{.color = Color(0, 0, 255),
+                                     .reflectivity = 0}));
+  assert(imported.meshQuadCount() == 1 && imported.meshTriangleCount() == 1);
+  BVH importedBVH(imported);
+  const Ray ray3(Vector(1.25, 0.25, 1.0), ray1.dir);
+  Hit importedHit;
+  assert(importedBVH.traverse(imported, ray3, importedHit));
+  assert(importedHit.prim.type == PrimRef::MESH_TRIANGLE);
+  std::remove(path.c_str());
+}
+
+void test_compressed_mesh() {
+  std::cout << "Testing CompressedMesh..." << std::endl;
+
+  // Octahedral normals survive a round trip in every octant
+  for (int i = 0; i < 1000; ++i) {
+    const double z = 1.0 - 2.0 * (i + 0.5) / 1000, phi = i * 2.39996;
+    const double r = std::sqrt(1.0 - z * z);
+    const Vector n(r * std::cos(phi), r * std::sin(phi), z);
+    assert(near(decodeOctahedral(encodeOctahedral(n)), n, 1e-4));
+  }
+  assert(encodeOctahedral(Vector()) == NO_NORMAL);
+
+  // Smooth shaded grid of 64 x 64 quads
+  const int size = 64;
+  std::vector<Vector> positions, normals;
+  std::vector<uint32_t> indices;
+  for (int y = 0; y <= size; ++y) {
+    for (int x = 0; x <= size; ++x) {
+      positions.push_back(Vector(x, y, std::sin(x * 0.1) * std::cos(y * 0.1)));
+      normals.push_back(Vector(-0.1 * std::cos(x * 0.1) * std::cos(y * 0.1),
+                               0.1 * std::sin(x * 0.1) * std::sin(y * 0.1), 1)
+                            .norm());
+    }
+  }
+  for (uint32_t y = 0; y < size; ++y) {
+    for (uint32_t x = 0; x < size; ++x) {
+      const uint32_t a = y * (size + 1) + x, b = a + size + 1;
+      indices.insert(indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+    }
+  }
+  const TriangleMesh mesh(positions, normals, indices, 0);
+  const CompressedMesh compressed(mesh);
+  assert(compressed.triangleCount() == mesh.triangleCount());
+  assert(compressed.positions.size() == 3 * positions.size());
+
+  // Decoded triangles are within a quantization step of the originals
+  for (size_t t = 0; t < mesh.triangleCount(); t += 97) {
+    const Bounds a = mesh.triangleBounds(t), b = compressed.triangleBounds(t);
+    assert(near(a.min, b.min, 1e-3) && near(a.max, b.max, 1e-3));
+  }
+  for (int i = 0; i < 100; ++i) {
+    const Ray ray(Vector(0.37 + i * 0.61, 0.53 + i * 0.59, 5.0),
+                  Vector(0.0, 0.0, -1.0));
+    size_t tri = 0, compressedTri = 0;
+    while (!mesh.intersects(tri, ray)) ++tri;
+    while (!compressed.intersects(compressedTri, ray)) ++compressedTri;
+    const auto expected = mesh.intersects(tri, ray);
+    const auto actual = compressed.intersects(compressedTri, ray);
+    assert(std::abs(expected->t - actual->t) < 1e-3);
+    assert(near(expected->normal, actual->normal, 1e-3));
+  }
+
+  // Scenes trace compressed meshes through the BVH
+  Scene scene(1, 1, 1);
+  scene.addMesh(positions, normals, indices,
+                Material{.color = Color(255, 0, 0), .reflectivity = 0});
+  scene.compressMeshes();
+  assert(scene.meshCount() == 0 && scene.compressedMeshCount() == 1);
+  assert(scene.compressedTriangleCount() == mesh.triangleCount());
+  BVH bvh(scene);
+  Hit hit;
+  const Ray ray(Vector(10.5, 20.25, 5.0), Vector(0.0, 0.0, -1.0));
+  assert(bvh.traverse(scene, ray, hit));
+  assert(hit.prim.type == PrimRef::COMPRESSED_TRIANGLE);
+  const double z = std::sin(1.05) * std::cos(2.025);
+  assert(std::abs(scene.hitInfo(hit, ray).pos.z() - z) < 1e-2);
+}
+
+void test_triangle_pack() {
+  std::cout << "Testing TrianglePack intersection..." << std::endl;
+
+  // Two stacked triangles in lanes 0 and 2, other lanes left empty
+  TrianglePack pack;
+  pack.set(0, Vector(0.0, 0.0, 0.0), Vector(1.0, 0.0, 0.0),
+           Vector(0.0, 1.0, 0.0));
+  pack.set(2, Vector(0.0, 0.0, 0.5), Vector(1.0, 0.0, 0.0),
+           Vector(0.0, 1.0, 0.0));
+
+  // Nearest lane wins
+  double t, u, v;
+  RayT<Real> ray1(VectorT<Real>(0.25, 0.75, 1.0),
+                  VectorT<Real>(0.0, 0.0, -1.0));
+  assert(pack.intersect(ray1, t, u, v) == 2);
+  assert(std::abs(t - 0.5) < 1e-6);
+  assert(std::abs(u - 0.25) < 1e-6 && std::abs(v - 0.75) < 1e-6);
+
+  // Behind the origin only the lower triangle is hit
+  RayT<Real> ray2(VectorT<Real>(0.25, 0.25, 0.25),
+                  VectorT<Real>(0.0, 0.0, -1.0));
+  assert(pack.intersect(ray2, t, u, v) == 0);
+  assert(std::abs(t - 0.25) < 1e-6);
+
+  // Outside both triangles
+  RayT<Real> ray3(VectorT<Real>(0.75, 0.75, 1.0),
+                  VectorT<Real>(0.0, 0.0, -1.0));
+  assert(pack.intersect(ray3, t, u, v) == -1);
+
+  // The tolerance suits the precision, and parallel rays are told apart by
+  // angle, so a triangle far smaller than it is still hit
+  assert(VectorT<Real>::EPS > 4 * std::numeric_limits<Real>::epsilon());
+  assert(VectorT<Real>::EPS < 1e-4);
+  TrianglePack tiny;
+  tiny.set(1, Vector(2.0, 2.0, 0.0), Vector(1e-4, 0.0, 0.0),
+           Vector(0.0, 1e-4, 0.0));
+  RayT<Real> ray4(VectorT<Real>(2.0 + 2e-5, 2.0 + 3e-5, 1.0),
+                  VectorT<Real>(0.0, 0.0, -1.0));
+  assert(tiny.intersect(ray4, t, u, v) == 1);
+  assert(std::abs(t - 1.0) < 1e-5);
+
+  // A ray along the plane of the triangles misses them
+  RayT<Real> ray5(VectorT<Real>(-1.0, 0.25, 0.0),
+                  VectorT<Real>(1.0, 0.0, 0.0));
+  assert(pack.intersect(ray5, t, u, v) == -1);
+}
+
+void test_bvh_stats() {
+  std::cout << "Testing BVH statistics..." << std::endl;
+
+  // A 10 x 10 grid of spheres and a strip of mesh triangles
+  Scene scene(1, 1, 1);
+  const Material mat{.color = Color(255, 0, 0), .reflectivity = 0};
+  for (int i = 0; i < 100; ++i) {
+    scene.addSphere(Vector(i % 10, i / 10, 0.0), 0.3, mat);
+  }
+  std::vector<Vector> positions;
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 30; ++i) {
+    positions.insert(positions.end(), {Vector(i, 12.0, 0.0),
+                                       Vector(i + 1.0, 12.0, 0.0),
+                                       Vector(i, 13.0, 0.0)});
+    indices.insert(indices.end(), {3 * i, 3 * i + 1, 3 * i + 2});
+  }
+  scene.addMesh(positions, {}, indices, mat);
+  const BVH bvh(scene);
+  const BVHStats stats = bvh.getStats();
+
+  // Counts agree with each other and with the tree
+  int leaves = 0;
+  size_t prims = 0;
+  for (size_t size = 0; size < stats.leafSizeHistogram.size(); ++size) {
+    leaves += stats.leafSizeHistogram[size];
+    prims += size * stats.leafSizeHistogram[size];
+  }
+  assert(stats.leafCount == leaves);
+  assert(prims == bvh.getPrims().size() && prims == 130);
+  assert(stats.nodeCount == 2 * stats.leafCount - 1);
+  assert(stats.nodeCount == static_cast<int>(bvh.getNodeCount()));
+  assert(stats.leafSizeHistogram[0] == 0);
+  assert((1 << stats.maxDepth) >= stats.leafCount);
+  assert(stats.avgLeafDepth > 0.0 && stats.avgLeafDepth <= stats.maxDepth);
+  assert(stats.sahCost > 1.0 && stats.siblingOverlap >= 0.0);
+  assert(stats.memoryBytes >= bvh.getNodeCount() * sizeof(BVHNode));
+  assert(!stats.buildTimes.empty());
+
+  // The report is valid JSON and holds the same numbers
+  std::ostringstream json;
+  stats.writeJSON(json);
+  assert(isJSON(json.str()));
+  assert(json.str().find("\"nodeCount\": " +
+                         std::to_string(stats.nodeCount) + ",") !=
+         std::string::npos);
+  assert(!isJSON("{\"a\": 1,}") && !isJSON("{\"a\": nan}"));
+  assert(!isJSON("[1, 2") && isJSON(" {\"a\": [1.5e-3, -0, \"b\"]} "));
+}
+
+void test_bvh_layout() {
+  std::cout << "Testing BVH node layout..." << std::endl;
+
+  // Trees from a single leaf up to thousands of nodes, balanced and lopsided
+  // (spheres spaced ever further apart), from both builders
+  const Material mat{.color = Color(255, 0, 0), .reflectivity = 0};
+  const BVHBuildMethod methods[] = {BVHBuildMethod::BINNED_SAH,
+                                    BVHBuildMethod::PLOC};
+  for (const int count : {1, 2, 9, 40, 3000}) {
+    for (const bool lopsided : {false, true}) {
+      for (const BVHBuildMethod method : methods) {
+        Scene scene(1, 1, 1);
+        scene.setCamera(Vector(0, 0, 10), Vector(0, 0, -1), 60.0);
+        scene.setBVHBuildMethod(method);
+        for (int i = 0; i < count; ++i) {
+          const double x = lopsided ? std::pow(1.0015, i) : i % 60;
+          scene.addSphere(Vector(x, lopsided ? 0 : i / 60, 0.0), 0.3, mat);
+        }
+        const BVH bvh(scene);
+        checkBVH(bvh);
+
+        // Top levels are laid out before the subtrees below them, so every
+        // node comes before its children and one child follows the root
+        const std::vector<BVHNode>& nodes = bvh.getNodes();
+        for (size_t i = 0; i < nodes.size(); ++i) {
+          if (nodes[i].shapeCount > 0) continue;
+          assert(nodes[i].left > static_cast<int>(i));
+          assert(nodes[i].right > static_cast<int>(i));
+        }
+        if (nodes.size() > 1) {
+          assert(std::min(nodes[0].left, nodes[0].right) == 1);
+        }
+
+        // Every sphere is still found where it was placed
+        for (int i = 0; i < count; i += 1 + count / 50) {
+          const double x = lopsided ? std::pow(1.0015, i) : i % 60;
+          const Vector center(x, lopsided ? 0 : i / 60, 0.0);
+          Hit hit;
+          const Ray ray(center + Vector(0.0, 0.0, 5.0), Vector(0, 0, -1));
+          assert(bvh.traverse(scene, ray, hit));
+          assert(std::abs(hit.t - 4.7) < 1e-4);
+        }
+      }
+    }
+  }
+}
+
+void test_bvh_ploc() {
+  std::cout << "Testing PLOC BVH build..." << std::endl;
+
+  // Random spheres, loose triangles, a mesh and cylinders, so both packed
+  // and scalar leaves are built
+  Scene scene(1, 1, 1);
+  scene.setCamera(Vector(0, -30, 0), Vector(0, 1, 0), 60.0);
+  const Material mat{.color = Color(255, 0, 0), .reflectivity = 0};
+  auto random = [](uint32_t i, uint32_t d) {
+    return 20.0 * randomUnit(i, 0, d, 7) - 10.0;
+  };
+  for (uint32_t i = 0; i < 300; ++i) {
+    const Vector c(random(i, 0), random(i, 1), random(i, 2));
+    if (i % 10 == 0) {
+      scene.addCylinder(c, 0.3, 0.8, mat);
+    } else if (i % 3 == 0) {
+      scene.addTriangle(c, c + Vector(0.7, 0, 0.2), c + Vector(0, 0.6, 0.5),
+                        mat);
+    } else {
+      scene.addSphere(c, 0.1 + 0.4 * randomUnit(i, 0, 3, 7), mat);
+    }
+  }
+  std::vector<Vector> positions;
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 200; ++i) {
+    const Vector c(random(i, 4), random(i, 5), random(i, 6));
+    positions.insert(positions.end(),
+                     {c, c + Vector(0.5, 0, 0), c + Vector(0, 0, 0.5)});
+    indices.insert(indices.end(), {3 * i, 3 * i + 1, 3 * i + 2});
+  }
+  scene.addMesh(positions, {}, indices, mat);
+
+  Scene plocScene = scene;
+  plocScene.setBVHBuildMethod(BVHBuildMethod::PLOC);
+  const BVH sah(scene);
+  const BVH ploc(plocScene);
+  checkBVH(sah);
+  checkBVH(ploc);
+  assert(ploc.getPrims().size() == sah.getPrims().size());
+
+  // Both trees find the same closest hit for every ray
+  int hits = 0;
+  for (uint32_t i = 0; i < 2000; ++i) {
+    const Vector from(random(i, 7) * 2.0, random(i, 8) * 2.0, 25.0);
+    const Vector to(random(i, 9), random(i, 10), random(i, 11));
+    const Ray ray(from, (to - from).norm());
+    Hit a, b;
+    const bool hitA = sah.traverse(scene, ray, a);
+    assert(ploc.traverse(plocScene, ray, b) == hitA);
+    if (!hitA) continue;
+    hits++;
+
+    // Spheres in packed leaves are tested in Real precision and in mixed
+    // leaves by the scalar quadratic, which may round quite differently
+    const double tolerance = std::sqrt(std::numeric_limits<Real>::epsilon());
+    assert(std::abs(a.t - b.t) <= tolerance * a.t);
+    assert(a.prim.type == b.prim.type && a.prim.object == b.prim.object &&
+           a.prim.element == b.prim.element);
+  }
+  assert(hits > 200);
+}
+
+void test_bvh_large_coordinates() {
+  std::cout << "Testing BVH far from the origin..." << std::endl;
+
+  // Two tiny triangles far from the origin, closer together than single
+  // precision can resolve at that magnitude
+  const Vector far(1e7, 1e7, 1e7);
+  const Vector x(1e-3, 0.0, 0.0), y(0.0, 1e-3, 0.0);
+  Scene scene(1, 1, 1);
+  scene.setCamera(far + Vector(0.0, 0.0, 1.0), Vector(0.0, 0.0, -1.0), 60.0);
+  scene.addMesh({far, far + x, far + y, far + 2 * x, far + 3 * x,
+                 far + 2 * x + y},
+                {}, {0, 1, 2, 3, 4, 5},
+                Material{.color = Color(255, 255, 255), .reflectivity = 0});
+  BVH bvh(scene);
+  assert(bvh.getOrigin() == scene.getCamera().position);
+
+  Hit hit;
+  Ray ray(far + Vector(2.25e-3, 0.25e-3, 1.0), Vector(0.0, 0.0, -1.0));
+  assert(bvh.traverse(scene, ray, hit));
+  assert(hit.prim.element == 1);
+  assert(std::abs(hit.t - 1.0) < 1e-6);
+
+  // The gap between the triangles is still empty
+  Hit miss;
+  Ray gap(far + Vector(1.5e-3, 0.75e-3, 1.0), Vector(0.0, 0.0, -1.0));
+  assert(!bvh.traverse(scene, gap, miss));
+}
+
+void test_contact_shadow_far() {
+  std::cout << "Testing contact shadows far from the camera..." << std::endl;
+
+  // A floor 1000 units from the camera, under a plate 0.02 above it
+  // Single precision geometry there is accurate to about 1e-4, so shadow rays
+  // must start closer to the floor than the plate to see it
+  Scene scene(1, 1, 1);
+  scene.setCamera(Vector(0, 0, 0), Vector(1, 0, 0), 60.0);
+  const Material matte{.color = Color(200, 200, 200), .reflectivity = 0};
+  scene.addMesh({Vector(990, -10, 0), Vector(1010, -10, 0),
+                 Vector(1010, 10, 0), Vector(990, 10, 0)},
+                {}, {0, 1, 2, 0, 2, 3}, matte);
+  const double gap = 0.02;
+  scene.addMesh({Vector(999, -1, gap), Vector(1001, -1, gap),
+                 Vector(1001, 1, gap), Vector(999, 1, gap)},
+                {}, {0, 1, 2, 0, 2, 3}, matte);
+  BVH bvh(scene);
+
+  const Vector light(1000, 0, 10);
+  const Vector up(0, 0, 1);
+  auto shadowed = [&](const Vector& p) {
+    const Vector start = p + up * rayOffset(p, bvh.getOrigin());
+    const Vector toLight = light - start;
+    const double dist = toLight.mag();
+    Hit hit;
+    return bvh.traverseFirstHit(scene, Ray(start, toLight / dist), dist,
+                                hit) != nullptr;
+  };
+  assert(rayOffset(Vector(1000, 0, 0), bvh.getOrigin()) < gap / 10);
+
+  // Under the plate is dark; the open floor and the plate's top are lit
+  assert(shadowed(Vector(1000.0, 0.0, 0.0)));
+  assert(shadowed(Vector(1000.9, -0.9, 0.0)));
+  assert(!shadowed(Vector(1005.3, 2.7, 0.0)));
+  assert(!shadowed(Vector(1000.3, 0.2, gap)));
+}
+
+void test_reorder_primitives() {
+  std::cout << "Testing primitive reordering..." << std::endl;
+
+  // Spheres along a line, added in scrambled order, and a mesh strip
+  Scene scene(1, 1, 1);
+  const Material mat{.color = Color(255, 0, 0), .reflectivity = 0};
+  for (int i = 0; i < 64; ++i) {
+    scene.addSphere(Vector((i * 37) % 64, 0.0, 0.0), 0.25, mat);
+  }
+  std::vector<Vector> positions;
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 32; ++i) {
+    positions.push_back(Vector((i * 13) % 32, 5.0, 0.0));
+    positions.push_back(Vector((i * 13) % 32, 6.0, 0.0));
+    positions.push_back(Vector((i * 13) % 32 + 0.5, 5.0, 0.0));
+    indices.insert(indices.end(), {3 * i, 3 * i + 1, 3 * i + 2});
+  }
+  scene.addMesh(positions, {}, indices, mat);
+
+  BVH bvh(scene);
+  std::vector<Hit> before;
+  for (int i = 0; i < 64; ++i) {
+    Hit hit;
+    assert(bvh.traverse(scene, Ray(Vector(i, 0.0, 5.0), Vector(0, 0, -1)),
+                        hit));
+    before.push_back(hit);
+  }
+  const Bounds oldBounds = scene.bounds();
+  bvh.reorderScene(scene);
+
+  // Spheres are numbered in leaf order and the same ones are still hit
+  uint32_t next = 0;
+  for (const PrimRef& prim : bvh.getPrims()) {
+    if (prim.type == PrimRef::SPHERE) assert(prim.object == next++);
+  }
+  assert(next == 64);
+  for (int i = 0; i < 64; ++i) {
+    Hit hit;
+    const Ray ray(Vector(i, 0.0, 5.0), Vector(0, 0, -1));
+    assert(bvh.traverse(scene, ray, hit));
+    assert(hit.t == before[i].t);
+    assert(near(scene.hitInfo(hit, ray).pos, Vector(i, 0.0, 0.25)));
+  }
+  assert(scene.bounds().min == oldBounds.min);
+  assert(scene.bounds().max == oldBounds.max);
+  Hit meshHit;
+  assert(bvh.traverse(scene, Ray(Vector(7.1, 5.1, 1.0), Vector(0, 0, -1)),
+                      meshHit));
+  assert(meshHit.prim.type == PrimRef::MESH_TRIANGLE);
+}
+
+void test_instance() {
+  std::cout << "Testing Instance intersection..." << std::endl;
+
+  // Unit sphere prototype with two materials of its own
+  Scene unit(1, 1, 1);
+  unit.addSphere(Vector(0.0, 0.0, 0.0), 1.0,
+                 Material{.color = Color(255, 0, 0), .reflectivity = 0});
+  unit.addSphere(Vector(0.0, 0.0, 5.0), 0.5,
+                 Material{.color = Color(0, 255, 0), .reflectivity = 0});
+  auto proto = std::make_shared<const Prototype>(unit);
+  assert(proto->getBounds().max == Vector(1.0, 1.0, 5.5));
+
+  // Two instances share the prototype and its materials
+  Scene scene(1, 1, 1);
+  scene.addSphere(Vector(0.0, 0.0, -10.0), 1.0,
+                  Material{.color = Color(0, 0, 255), .reflectivity = 0});
+  const Transform big = Transform::translate(Vector(10.0, 0.0, 0.0)) *
+                        Transform::scale(Vector(2.0, 2.0, 2.0));
+  const size_t first = scene.addInstance(proto, big);
+  scene.addInstance(proto, Transform::translate(Vector(-10.0, 0.0, 0.0)));
+  assert(scene.instanceCount() == 2);
+  assert(scene.boundedShapeCount() == 3);
+
+  const Bounds b = scene.bounds();
+  assert(near(b.min, Vector(-11.0, -2.0, -11.0)));
+  assert(near(b.max, Vector(12.0, 2.0, 11.0)));
+
+  // From above, the scaled small sphere is hit first
+  BVH bvh(scene);
+  Hit hit;
+  const Ray ray(Vector(10.0, 0.0, 20.0), Vector(0.0, 0.0, -1.0));
+  assert(bvh.traverse(scene, ray, hit));
+  assert(hit.prim.type == PrimRef::INSTANCE && hit.prim.object == first);
+  assert(std::abs(hit.t - 9.0) < 1e-6);
+  HitInfo info = scene.hitInfo(hit, ray);
+  assert(near(info.pos, Vector(10.0, 0.0, 11.0)));
+  assert(near(info.normal, Vector(0.0, 0.0, 1.0)));
+  assert(info.materialIndex == 2);
+
+  // Moving an instance takes effect in the next BVH
+  scene.setInstanceTransform(first,
+                             Transform::translate(Vector(0.0, 30.0, 0.0)));
+  BVH moved(scene);
+  Hit miss;
+  assert(!moved.traverse(scene, ray, miss));
+}
+
+void test_material_interning() {
+  std::cout << "Testing material interning..." << std::endl;
+
+  const Material red{.color = Color(255, 0, 0), .reflectivity = 0};
+  const Material shinyRed{.color = Color(255, 0, 0), .reflectivity = 0.5};
+
+  // Equal materials share one entry however many shapes use them
+  Scene scene(1, 1, 1);
+  for (int i = 0; i < 100; ++i) {
+    scene.addSphere(Vector(i, 0.0, 0.0), 0.5, red);
+  }
+  scene.addMesh({Vector(0, 0, 0), Vector(1, 0, 0), Vector(0, 1, 0)}, {},
+                {0, 1, 2}, red);
+  assert(scene.materialCount() == 1);
+  scene.addSphere(Vector(0.0, 5.0, 0.0), 0.5, shinyRed);
+  scene.addPlane(Vector(0, 0, -1), Vector(0, 0, 1), red);
+  assert(scene.materialCount() == 2);
+
+  // Hits still resolve to the material their shape was added with
+  BVH bvh(scene);
+  Hit hit;
+  const Ray ray(Vector(0.0, 5.0, 5.0), Vector(0.0, 0.0, -1.0));
+  assert(bvh.traverse(scene, ray, hit));
+  assert(scene.hitInfo(hit, ray).materialIndex == 1);
+}
+
+void test_mesh_lod() {
+  std::cout << "Testing mesh level of detail..." << std::endl;
+
+  // Unit UV sphere of 32 x 16 quads split into triangles
+  const int slices = 32, stacks = 16;
+  std::vector<Vector> positions;
+  std::vector<uint32_t> indices;
+  for (int j = 0; j <= stacks; ++j) {
+    const double theta = M_PI * j / stacks;
+    for (int i = 0; i <= slices; ++i) {
+      const double phi = 2.0 * M_PI * i / slices;
+      positions.push_back(Vector(std::sin(theta) * std::cos(phi),
+                                 std::sin(theta) * std::sin(phi),
+                                 std::cos(theta)));
+    }
+  }
+  for (int j = 0; j < stacks; ++j) {
+    for (int i = 0; i < slices; ++i) {
+      const uint32_t a = j * (slices + 1) + i, b = a + slices + 1;
+      indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  const TriangleMesh mesh(positions, {}, indices, 0);
+
+  // Halving keeps the silhouette and lengthens the edges
+  const TriangleMesh half = mesh.simplified(mesh.triangleCount() / 2);
+  assert(half.triangleCount() <= mesh.triangleCount() / 2);
+  assert(half.triangleCount() > mesh.triangleCount() / 4);
+  assert(half.meanEdgeLength() > mesh.meanEdgeLength());
+  Bounds b;
+  for (size_t t = 0; t < half.triangleCount(); ++t) {
+    b.expand(half.triangleBounds(t));
+  }
+  assert(near(b.min, Vector(-1.0, -1.0, -1.0), 0.1));
+  assert(near(b.max, Vector(1.0, 1.0, 1.0), 0.1));
+
+  // Prototype levels get coarser and are picked by footprint
+  Scene unit(0, 0, 0);
+  unit.addMesh(positions, {}, indices,
+               Material{.color = Color(255, 0, 0), .reflectivity = 0});
+  auto proto = std::make_shared<const Prototype>(unit, 3);
+  assert(proto->levelCount() == 4);
+  for (size_t l = 1; l < proto->levelCount(); ++l) {
+    assert(proto->getLevel(l).edgeLength > proto->getLevel(l - 1).edgeLength);
+  }
+  assert(proto->selectLevel(0.0, 0.5) == 0);
+  assert(proto->selectLevel(100.0, 0.5) == 3);
+
+  // Seen from far away, the coarsest level is traced
+  Scene scene(100, 100, 1);
+  scene.setCamera(Vector(1000.0, 0.0, 0.0), Vector(-1.0, 0.0, 0.0), 60.0);
+  scene.addInstance(proto, Transform());
+  BVH bvh(scene);
+  setLodView(scene.lodView());
+
+  // The ray is aimed inside a face, away from the vertex at (1, 0, 0)
+  Hit hit;
+  const Vector offset(0.0, 0.05, -0.07);
+  const Ray ray(Vector(1000.0, 0.0, 0.0) + offset, Vector(-1.0, 0.0, 0.0));
+  assert(bvh.traverse(scene, ray, hit));
+  assert(hit.u == 3.0);
+  assert(std::abs(hit.t - 999.0) < 0.1);
+  const HitInfo info = scene.hitInfo(hit, ray);
+  assert(info.normal.x() > 0.9);
+
+  // Moving the camera changes nothing until the view is taken again
+  scene.setCamera(Vector(1.5, 0.0, 0.0), Vector(-1.0, 0.0, 0.0), 60.0);
+  const Ray close(Vector(1.5, 0.0, 0.0) + offset, ray.dir);
+  assert(bvh.traverse(scene, close, hit));
+  assert(hit.u == 3.0);
+
+  // Up close, the full mesh is
+  setLodView(scene.lodView());
+  assert(bvh.traverse(scene, close, hit));
+  assert(hit.u == 0.0);
+
+  // Rays leaving a hit keep its level, whatever the view would pick
+  setLodHit(scene.lodHit(hit));
+  scene.setCamera(Vector(1000.0, 0.0, 0.0), Vector(-1.0, 0.0, 0.0), 60.0);
+  setLodView(scene.lodView());
+  Hit pinned;
+  assert(bvh.traverse(scene, close, pinned));
+  assert(pinned.u == 0.0);
+  setLodHit(LodHit{});
+  Hit unpinned;
+  assert(bvh.traverse(scene, close, unpinned));
+  assert(unpinned.u == 3.0);
+
+  // Levels are picked per ray, so a large ground mesh seen from just above
+  // is traced in full detail below the camera and coarser toward the horizon
+  const int cells = 64;
+  std::vector<Vector> grid;
+  std::vector<uint32_t> gridIndices;
+  for (int j = 0; j <= cells; ++j) {
+    for (int i = 0; i <= cells; ++i) {
+      grid.push_back(Vector(1000.0 * i / cells - 500.0,
+                            1000.0 * j / cells - 500.0, 0.0));
+    }
+  }
+  for (int j = 0; j < cells; ++j) {
+    for (int i = 0; i < cells; ++i) {
+      const uint32_t a = j * (cells + 1) + i, b = a + cells + 1;
+      gridIndices.insert(gridIndices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  Scene ground(0, 0, 0);
+  ground.addMesh(grid, {}, gridIndices,
+                 Material{.color = Color(0, 255, 0), .reflectivity = 0});
+  Scene field(10, 10, 1);
+  field.setCamera(Vector(0.0, 0.0, 10.0), Vector(1.0, 0.0, 0.0), 60.0);
+  field.addInstance(std::make_shared<const Prototype>(ground, 3),
+                    Transform());
+  BVH fieldBVH(field);
+  setLodView(field.lodView());
+  const Vector eye(0.0, 0.0, 10.0);
+  Hit below, horizon;
+  assert(fieldBVH.traverse(field, Ray(eye, Vector(0.3, 0.2, -1.0)), below));
+  assert(below.u == 0.0);
+  assert(fieldBVH.traverse(field, Ray(eye, Vector(400.0, 0.3, -10.0)),
+                           horizon));
+  assert(horizon.u > 0.0);
+  setLodView(LodView{});
+}
+
+void test_wavefront() {
+  std::cout << "Testing wavefront tracing..." << std::endl;
+
+  // Reflective spheres over a plane, lit by two lights, one behind a sphere
+  const int w = 48, h = 32;
+  Scene scene(w, h, 4);
+  scene.setCamera(Vector(0, -6, 2), Vector(0, 1, -0.2), 60.0);
+  scene.setAmbientLight(0.2);
+  scene.setBackground(20, 40, 80);
+  scene.addLight(Vector(3, -3, 6), Color(255, 255, 255));
+  scene.addLight(Vector(0, 6, 0.5), Color(255, 200, 150));
+  const Material mirror{.color = Color(200, 200, 200), .reflectivity = 0.6};
+  const Material matte{.color = Color(50, 200, 50), .reflectivity = 0};
+  scene.addPlane(Vector(0, 0, -1), Vector(0, 0, 1), matte);
+  scene.addSphere(Vector(-1, 0, 0), 1.0, mirror);
+  scene.addSphere(Vector(1.2, 1, 0), 0.8, matte);
+  scene.addCylinder(Vector(0, 3, 0), 0.5, 2.0, mirror);
+
+  // Samples are fixed per pixel and sample index, so both modes must agree
+  Scene wavefrontScene = scene;
+  wavefrontScene.setTraceMode(TraceMode::WAVEFRONT);
+  Tracer depthFirst(scene);
+  Tracer wavefront(wavefrontScene);
+  Pixels expected(w, h), actual(w, h);
+  depthFirst.refinePixels(expected);
+  depthFirst.wait();
+  wavefront.refinePixels(actual);
+  wavefront.wait();
+  for (int i = 0; i < w * h; ++i) {
+    assert(actual.pxSamples[i] == 1);
+    assert(actual.pxColors[i] == expected.pxColors[i]);
+  }
+  for (int y = 0; y < h; ++y) {
+    assert(actual.rowReady[y].load());
+  }
+
+  // Every camera ray is extended; every hit casts one shadow ray per light
+  const WavefrontStats stats = wavefront.getWavefrontStats();
+  assert(stats.cameraRays == static_cast<uint64_t>(w * h));
+  assert(stats.extendRays > stats.cameraRays);
+  assert(stats.shadedHits > 0 && stats.shadedHits <= stats.extendRays);
+  assert(stats.shadowRays == 2 * stats.shadedHits);
+  assert(depthFirst.getWavefrontStats().cameraRays == 0);
+}
+
+void test_thread_pool() {
+  std::cout << "Testing thread pool..." << std::endl;
+
+  // A running task keeps the pool busy after the queue has emptied
+  ThreadPool pool(2);
+  assert(pool.idle());
+  std::atomic_bool started{false}, release{false};
+  pool.enqueue([&]() {
+    started = true;
+    while (!release) std::this_thread::yield();
+  });
+  while (!started) std::this_thread::yield();
+  assert(pool.numTasks() == 0);
+  assert(!pool.idle());
+  release = true;
+  pool.wait();
+  assert(pool.idle());
+}
+
+void test_adaptive_sampling() {
+  std::cout << "Testing adaptive sampling..." << std::endl;
+
+  // A sphere in the middle of a flat background
+  const int w = 32, h = 24;
+  Scene scene(w, h, 1);
+  scene.setCamera(Vector(0, -5, 0), Vector(0, 1, 0), 60.0);
+  scene.setAmbientLight(0.2);
+  scene.addLight(Vector(2, -4, 3), Color(255, 255, 255));
+  scene.addSphere(Vector(0, 0, 0), 1.0,
+                  Material{.color = Color(200, 50, 50), .reflectivity = 0});
+  bool threw = false;
+  try {
+    scene.setNoiseThreshold(-1.0);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // Background pixels converge at once; the sphere's silhouette keeps going
+  const int passes = 20;
+  Tracer tracer(scene);
+  Pixels pixels(w, h);
+  for (int q = 0; q < passes; ++q) {
+    tracer.refinePixels(pixels);
+    tracer.wait();
+  }
+  assert(pixels.passes == passes);
+  int most = 0;
+  for (int n : pixels.pxSamples) most = std::max(most, n);
+  assert(most == passes);
+  assert(pixels.pxSamples[0] > 1 && pixels.pxSamples[0] < passes);
+  assert(pixels.error(0) == 0.0);
+  assert(pixels.tileDone[0]);
+  assert(pixels.pxColors[0] == scene.getBackground() * pixels.pxSamples[0]);
+
+  pixels.clear();
+  assert(pixels.passes == 0 && pixels.pxSamples[0] == 0 && !pixels.tileDone[0]);
+
+  // Without a threshold every pixel is sampled on every pass
+  Scene uniform = scene;
+  uniform.setNoiseThreshold(0.0);
+  Tracer uniformTracer(uniform);
+  for (int q = 0; q < passes; ++q) {
+    uniformTracer.refinePixels(pixels);
+    uniformTracer.wait();
+  }
+  for (int n : pixels.pxSamples) assert(n == passes);
+}
+
+void test_tile_scheduling() {
+  std::cout << "Testing tile scheduling..." << std::endl;
+
+  // Tiles are visited along a Z-order curve
+  assert(mortonCode(0u, 0u) == 0 && mortonCode(1u, 0u) == 1);
+  assert(mortonCode(0u, 1u) == 2 && mortonCode(1u, 1u) == 3);
+  assert(mortonCode(2u, 0u) == 4 && mortonCode(0xffffu, 0xffffu) == ~0u);
+
+  Scene scene(45, 29, 2);
+  scene.setCamera(Vector(0, -5, 0), Vector(0, 1, 0), 60.0);
+  scene.addLight(Vector(2, -4, 3), Color(255, 255, 255));
+  scene.addSphere(Vector(0, 0, 0), 1.0,
+                  Material{.color = Color(200, 50, 50), .reflectivity = 0.5});
+  scene.setNoiseThreshold(0.0);
+  bool threw = false;
+  try {
+    scene.setTileSize(-8);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // Tiles that don't divide the image, automatic tiles and wavefront batches
+  // of several tiles all cover every pixel exactly once per pass
+  const TraceMode modes[] = {TraceMode::DEPTH_FIRST, TraceMode::WAVEFRONT};
+  for (const int size : {20, 0, 8}) {
+    for (const TraceMode mode : modes) {
+      Scene tiled = scene;
+      tiled.setTileSize(size);
+      tiled.setTraceMode(mode);
+      Tracer tracer(tiled);
+      Pixels pixels(tiled.getWidth(), tiled.getHeight());
+      for (int q = 0; q < 3; ++q) {
+        tracer.refinePixels(pixels);
+        tracer.wait();
+      }
+      for (int n : pixels.pxSamples) assert(n == 3);
+      for (const std::atomic_bool& ready : pixels.rowReady) {
+        assert(ready.load());
+      }
+    }
+  }
+}
+
+void test_samplers() {
+  std::cout << "Testing samplers..." << std::endl;
+
+  const SamplerType types[] = {SamplerType::STRATIFIED, SamplerType::SOBOL,
+                               SamplerType::HALTON, SamplerType::LATTICE};
+  for (const SamplerType type : types) {
+    const std::unique_ptr<Sampler> sampler = Sampler::create(type, 64);
+    for (uint32_t pixel = 0; pixel < 64 * 64; pixel += 97) {
+      for (uint32_t index = 0; index < 64; ++index) {
+        for (uint32_t dimension = 0; dimension < 12; ++dimension) {
+          const double x = sampler->get(pixel, index, dimension);
+          assert(x >= 0.0 && x < 1.0);
+          assert(sampler->get(pixel, index, dimension) == x);
+        }
+      }
+    }
+  }
+
+  // Each power of two of Sobol samples puts one in every cell of a grid
+  const std::unique_ptr<Sampler> sobol =
+      Sampler::create(SamplerType::SOBOL, 64);
+  for (uint32_t pixel = 0; pixel < 8; ++pixel) {
+    std::array<int, 16> cells{};
+    for (uint32_t index = 0; index < 16; ++index) {
+      const int x = static_cast<int>(sobol->get(pixel, index, 0) * 4);
+      const int y = static_cast<int>(sobol->get(pixel, index, 1) * 4);
+      cells[y * 4 + x]++;
+    }
+    for (const int count : cells) assert(count == 1);
+  }
+  // Pixels get different points
+  assert(sobol->get(0, 0, 0) != sobol->get(1, 0, 0));
+
+  // The first sample of the stratified sampler is the pixel center
+  const std::unique_ptr<Sampler> stratified =
+      Sampler::create(SamplerType::STRATIFIED, 64);
+  assert(stratified->get(5, 0, 0) == 0.5 && stratified->get(5, 0, 1) == 0.5);
+
+  // Renders are reproducible, whichever thread traces which tile, and the
+  // seed picks a different set of samples
+  Scene scene(24, 16, 2);
+  scene.setCamera(Vector(0, -5, 0), Vector(0, 1, 0), 60.0);
+  scene.addLight(Vector(2, -4, 3), Color(255, 255, 255));
+  scene.addSphere(Vector(0, 0, 0), 1.0,
+                  Material{.color = Color(200, 50, 50), .reflectivity = 0.5});
+  scene.setSamplerType(SamplerType::STRATIFIED);
+  auto render = [](Scene& sc) {
+    Tracer tracer(sc);
+    Pixels pixels(sc.getWidth(), sc.getHeight());
+    for (int q = 0; q < 4; ++q) {
+      tracer.refinePixels(pixels);
+      tracer.wait();
+    }
+    return pixels.pxColors;
+  };
+  const std::vector<Color> first = render(scene);
+  assert(render(scene) == first);
+  scene.setSeed(7);
+  assert(render(scene) != first);
+}
+
+void test_random() {
+  std::cout << "Testing random numbers..." << std::endl;
+
+  // Every key changes the value; the same key always gives the same one
+  const uint32_t bits = randomBits(1, 2, 3, 4);
+  assert(randomBits(1, 2, 3, 4) == bits);
+  assert(randomBits(0, 2, 3, 4) != bits && randomBits(1, 0, 3, 4) != bits);
+  assert(randomBits(1, 2, 0, 4) != bits && randomBits(1, 2, 3, 0) != bits);
+
+  // Values are uniform over consecutive keys
+  const int n = 1 << 16;
+  double sum = 0.0;
+  std::array<int, 32> ones{};
+  for (int i = 0; i < n; ++i) {
+    const double x = randomUnit(i % 256, i / 256, 0, 0);
+    assert(x >= 0.0 && x < 1.0);
+    sum += x;
+    const uint32_t b = randomBits(i % 256, i / 256, 1, 0);
+    for (int k = 0; k < 32; ++k) ones[k] += (b >> k) & 1;
+  }
+  assert(std::abs(sum / n - 0.5) < 0.01);
+  for (const int count : ones) assert(std::abs(count - n / 2) < n / 50);
+}
+
+void test_shadow_occlusion() {
+  std::cout << "Testing shadow occlusion..." << std::endl;
+
+  // A floor lit from z = 3, with blockers between the two and spheres above
+  // the light that a shadow ray would reach if it ran past the light
+  const int w = 48, h = 48;
+  Scene scene(w, h, 1);
+  scene.setCamera(Vector(0, -6, 5), Vector(0, 1, -0.8), 60.0);
+  scene.setAmbientLight(0.2);
+  scene.setNoiseThreshold(0.0);
+  const Vector light(0, 0, 3);
+  scene.addLight(light, Color(255, 255, 255));
+  const Material matte{.color = Color(200, 200, 200), .reflectivity = 0};
+  scene.addPlane(Vector(0, 0, 0), Vector(0, 0, 1), matte);
+  for (int i = 0; i < 4; ++i) {
+    const double x = -1.5 + i;
+    scene.addSphere(Vector(x, 0.5 * i - 1.0, 1.5), 0.3, matte);
+    scene.addSphere(Vector(x, 0, 5), 0.8, matte);
+    scene.addSphere(Vector(0, x, 6), 0.6, matte);
+  }
+
+  // The first hit only counts between the point and the light, so it agrees
+  // with testing every shape
+  BVH bvh(scene);
+  int shadowed = 0, lit = 0;
+  for (double y = -3; y <= 3; y += 0.125) {
+    for (double x = -3; x <= 3; x += 0.125) {
+      const Vector point(x, y, 0);
+      const double dist = (light - point).mag();
+      const Ray ray(point, (light - point) / dist);
+      bool blocked = false;
+      for (const PrimRef& prim : bvh.getPrims()) {
+        Hit hit;
+        if (scene.intersect(prim, ray, hit) && hit.t > Vector::EPS &&
+            hit.t < dist) {
+          blocked = true;
+        }
+      }
+      Hit hit;
+      const PrimRef* first = bvh.traverseFirstHit(scene, ray, dist, hit);
+      assert((first != nullptr) == blocked);
+      assert(!first || (hit.t > Vector::EPS && hit.t < dist));
+      (blocked ? shadowed : lit)++;
+    }
+  }
+  assert(shadowed > 0 && lit > shadowed);
+
+  // Small and large tiles leave different occluders in each thread's cache,
+  // but the image doesn't depend on them
+  std::vector<Color> expected;
+  for (const int size : {8, 48}) {
+    Scene tiled = scene;
+    tiled.setTileSize(size);
+    Tracer tracer(tiled);
+    Pixels pixels(w, h);
+    for (int q = 0; q < 4; ++q) {
+      tracer.refinePixels(pixels);
+      tracer.wait();
+    }
+    if (expected.empty()) expected = pixels.pxColors;
+    assert(pixels.pxColors == expected);
+
+    // Neighboring shadowed pixels are mostly blocked by the same sphere
+    const ShadowCacheStats stats = tracer.getShadowCacheStats();
+    assert(stats.lookups > 0);
+    assert(stats.hits > 0 && stats.hits <= stats.lookups);
+    assert(stats.hitRate() > 0.0 && stats.hitRate() <= 1.0);
+  }
+}
+
+void test_reproducible_render() {
+  std::cout << "Testing reproducible renders..." << std::endl;
+
+  // Mirrors, a mesh and shadows, sampled adaptively with the default sampler
+  const int w = 40, h = 30;
+  Scene scene(w, h, 4);
+  scene.setCamera(Vector(0, -6, 2), Vector(0, 1, -0.3), 60.0);
+  scene.setAmbientLight(0.2);
+  scene.setBackground(20, 40, 80);
+  scene.addLight(Vector(3, -3, 6), Color(255, 255, 255));
+  scene.addLight(Vector(-2, 1, 3), Color(255, 200, 150));
+  const Material mirror{.color = Color(200, 200, 200), .reflectivity = 0.6};
+  const Material matte{.color = Color(50, 200, 50), .reflectivity = 0};
+  scene.addPlane(Vector(0, 0, -1), Vector(0, 0, 1), matte);
+  scene.addSphere(Vector(-1, 0, 0), 1.0, mirror);
+  scene.addSphere(Vector(1.2, 1, 0), 0.8, matte);
+  scene.addMesh({Vector(0, 2, -1), Vector(2, 2, -1), Vector(1, 2, 1)}, {},
+                {0, 1, 2}, mirror);
+
+  // Tiles of different sizes hand the pixels to the threads in a different
+  // order, and wavefront batches trace them stage by stage, but every pixel
+  // gets the same samples and the same color
+  struct Setup {
+    int tileSize;
+    TraceMode mode;
+  };
+  const Setup setups[] = {{8, TraceMode::DEPTH_FIRST},
+                          {40, TraceMode::DEPTH_FIRST},
+                          {16, TraceMode::WAVEFRONT}};
+  std::vector<Color> colors;
+  std::vector<int> samples;
+  for (const Setup& setup : setups) {
+    Scene tiled = scene;
+    tiled.setTileSize(setup.tileSize);
+    tiled.setTraceMode(setup.mode);
+    Tracer tracer(tiled);
+    Pixels pixels(w, h);
+    for (int q = 0; q < 12; ++q) {
+      tracer.refinePixels(pixels);
+      tracer.wait();
+    }
+    if (colors.empty()) {
+      colors = pixels.pxColors;
+      samples = pixels.pxSamples;
+    }
+    assert(pixels.pxColors == colors);
+    assert(pixels.pxSamples == samples);
+  }
+}
+
 int main() {
   test_color();
   test_vector();
+  test_transform();
+  test_bounds_precision();
   test_sphere_intersect();
+  test_sphere_set();
+  test_sphere_pack();
   test_plane_intersect();
   test_triangle_intersect();
   test_cylinder_intersect();
+  test_distance_field();
+  test_mesh_intersect();
+  test_quad_intersect();
+  test_compressed_mesh();
+  test_triangle_pack();
+  test_bvh_stats();
+  test_bvh_ploc();
+  test_bvh_layout();
+  test_bvh_large_coordinates();
+  test_contact_shadow_far();
+  test_reorder_primitives();
+  test_instance();
+  test_material_interning();
+  test_mesh_lod();
+  test_wavefront();
+  test_thread_pool();
+  test_adaptive_sampling();
+  test_tile_scheduling();
+  test_samplers();
+  test_random();
+  test_shadow_occlusion();
+  test_reproducible_render();
 
   std::cout << "All tests passed!" << std::endl;
 